@@ -0,0 +1,232 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <cassert>
+#include <cstring>
+#include "Heap.h"
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+//Values written either side of a tracked allocation so overruns can be caught on delete
+const int checkValueHeader = (int)0xDEADC0DE;
+const int checkValFooter = (int)0xDEADBEEF;
+
+//16 byte aligned so the block after it keeps malloc's alignment
+struct alignas(16) Header
+{
+	size_t size;
+	int checkValue;
+	Heap* heap;
+	//intrusive list of the live blocks owned by heap, walked by Heap::Walk
+	Header* prev;
+	Header* next;
+};
+
+struct Footer
+{
+	int reserve;
+	int checkValue;
+};
+
+//Guard policies: write the check values on new and assert on them at delete
+struct GuardCheckPolicy
+{
+	static const bool enabled = true;
+	static const size_t footerSize = sizeof(Footer);
+
+	//the footer sits straight after the caller's bytes so it's rarely aligned, it's only ever copied in and out
+	static void Write(Header* pHeader, char* pFooterAddr)
+	{
+		pHeader->checkValue = checkValueHeader;
+		Footer footer = { 0, checkValFooter };
+		memcpy(pFooterAddr, &footer, sizeof(Footer));
+	}
+	static void Check(Header* pHeader, char* pFooterAddr)
+	{
+		assert(Valid(pHeader, pFooterAddr));
+		(void)pHeader;
+		(void)pFooterAddr;
+	}
+	static bool Valid(Header* pHeader, char* pFooterAddr)
+	{
+		Footer footer;
+		memcpy(&footer, pFooterAddr, sizeof(Footer));
+		return pHeader->checkValue == checkValueHeader && footer.checkValue == checkValFooter;
+	}
+};
+
+struct NoGuardCheckPolicy
+{
+	static const bool enabled = false;
+	static const size_t footerSize = 0;
+
+	static void Write(Header*, char*) {}
+	static void Check(Header*, char*) {}
+	static bool Valid(Header*, char*) { return true; }
+};
+
+//Heap tag policies: record which heap owns the block and link it into that heap's live list
+//so delete can hand the bytes back and the heap can be walked
+struct HeapTagPolicy
+{
+	static const bool enabled = true;
+
+	static void Tag(Header* pHeader, Heap* pHeap)
+	{
+		pHeader->heap = pHeap;
+		pHeader->prev = nullptr;
+		pHeader->next = nullptr;
+		if (pHeap != nullptr)
+			pHeap->AddAllocation(pHeader);
+	}
+	static Heap* Untag(Header* pHeader)
+	{
+		if (pHeader->heap != nullptr)
+			pHeader->heap->RemoveAllocation(pHeader);
+		return pHeader->heap;
+	}
+};
+
+struct NoHeapTagPolicy
+{
+	static const bool enabled = false;
+
+	static void Tag(Header*, Heap*) {}
+	static Heap* Untag(Header*) { return nullptr; }
+};
+
+//Size tracking policies: remember the requested size so the footer and heap totals can be found again
+struct SizeTrackPolicy
+{
+	static const bool enabled = true;
+
+	static void Record(Header* pHeader, size_t size) { pHeader->size = size; }
+	static size_t Size(Header* pHeader) { return pHeader->size; }
+};
+
+struct NoSizeTrackPolicy
+{
+	static const bool enabled = false;
+
+	static void Record(Header*, size_t) {}
+	static size_t Size(Header*) { return 0; }
+};
+
+//Builds the global allocation path out of the three policies above. When every policy is
+//disabled no header or footer is written and new/delete go straight to malloc/free, or to the
+//heap's mapped arena when one was given.
+template<typename GuardPolicy, typename TagPolicy, typename SizePolicy>
+class Allocator
+{
+public:
+	static_assert(!GuardPolicy::enabled || SizePolicy::enabled, "Guard checking needs size tracking to find the footer");
+	static_assert(!TagPolicy::enabled || SizePolicy::enabled, "Heap tagging needs size tracking to credit the heap on delete");
+
+	static const bool hasHeader = GuardPolicy::enabled || TagPolicy::enabled || SizePolicy::enabled;
+	static const size_t headerSize = hasHeader ? sizeof(Header) : 0;
+	static const size_t overhead = headerSize + GuardPolicy::footerSize;
+
+	//Returns null on failure, the operator new overloads decide whether that throws
+	static void* Allocate(size_t size, Heap* pHeap, size_t alignment = 0)
+	{
+		size_t offset = HeaderOffset(alignment);
+		char* pMem = (char*)RawAlloc(offset + size + GuardPolicy::footerSize, alignment, pHeap);
+		if (pMem == nullptr)
+			return nullptr;
+
+		char* pStartMemoryBlock = pMem + offset;
+		if (hasHeader)
+		{
+			Header* pHeader = (Header*)(pStartMemoryBlock - sizeof(Header));
+			SizePolicy::Record(pHeader, size);
+			GuardPolicy::Write(pHeader, pStartMemoryBlock + size);
+			TagPolicy::Tag(pHeader, pHeap);
+			if (TagPolicy::enabled && pHeap != nullptr)
+				pHeap->Allocate(size + overhead);
+		}
+		return pStartMemoryBlock;
+	}
+
+	//size is the value passed to sized delete, or 0 when it isn't known
+	static void Free(void* pMem, size_t alignment = 0, size_t size = 0)
+	{
+		if (pMem == nullptr)
+			return;
+
+		char* pStartMemoryBlock = (char*)pMem;
+		if (hasHeader)
+		{
+			Header* pHeader = (Header*)(pStartMemoryBlock - sizeof(Header));
+			size_t trackedSize = SizePolicy::Size(pHeader);
+			assert(!SizePolicy::enabled || size == 0 || size == trackedSize);
+			(void)size;
+			GuardPolicy::Check(pHeader, pStartMemoryBlock + trackedSize);
+			Heap* pHeap = TagPolicy::Untag(pHeader);
+			if (TagPolicy::enabled && pHeap != nullptr)
+				pHeap->DelAllocation(trackedSize + overhead);
+		}
+		RawFree(pStartMemoryBlock - HeaderOffset(alignment), alignment);
+	}
+
+	//Non-asserting guard check used when walking a heap
+	static bool Verify(Header* pHeader)
+	{
+		char* pStartMemoryBlock = (char*)pHeader + sizeof(Header);
+		return GuardPolicy::Valid(pHeader, pStartMemoryBlock + SizePolicy::Size(pHeader));
+	}
+
+private:
+	//Over-aligned blocks push the header forward so the user pointer lands on the alignment
+	static size_t HeaderOffset(size_t alignment)
+	{
+		if (!hasHeader)
+			return 0;
+		if (alignment == 0)
+			return sizeof(Header);
+		return (sizeof(Header) + alignment - 1) / alignment * alignment;
+	}
+
+	static void* RawAlloc(size_t bytes, size_t alignment, Heap* pHeap)
+	{
+		//mapped heaps serve what they can and fall back to the system allocator when they're full
+		if (pHeap != nullptr && pHeap->IsMapped())
+		{
+			void* pArenaMem = pHeap->ArenaAlloc(bytes, alignment);
+			if (pArenaMem != nullptr)
+				return pArenaMem;
+		}
+		if (alignment == 0)
+			return malloc(bytes);
+#ifdef _WIN32
+		return _aligned_malloc(bytes, alignment);
+#else
+		void* pMem = nullptr;
+		if (posix_memalign(&pMem, alignment < sizeof(void*) ? sizeof(void*) : alignment, bytes) != 0)
+			return nullptr;
+		return pMem;
+#endif
+	}
+
+	static void RawFree(void* pMem, size_t alignment)
+	{
+		Heap* pMappedHeap = Heap::FindMappedHeap(pMem);
+		if (pMappedHeap != nullptr)
+		{
+			pMappedHeap->ArenaFree(pMem);
+			return;
+		}
+#ifdef _WIN32
+		if (alignment != 0)
+		{
+			_aligned_free(pMem);
+			return;
+		}
+#else
+		(void)alignment;
+#endif
+		free(pMem);
+	}
+};
@@ -0,0 +1,183 @@
+#include "AviWriter.h"
+#include <iostream>
+#include <sstream>
+
+//AVI header flags
+#define AVIF_HASINDEX 0x10
+#define AVIIF_KEYFRAME 0x10
+
+//Fixed layout sizes, the hdrl list is everything from its 'hdrl' fourcc to the end of strf
+#define AVI_AVIH_SIZE 56
+#define AVI_STRH_SIZE 56
+#define AVI_STRF_SIZE 40
+#define AVI_STRL_SIZE (4 + 8 + AVI_STRH_SIZE + 8 + AVI_STRF_SIZE)
+#define AVI_HDRL_SIZE (4 + 8 + AVI_AVIH_SIZE + 8 + AVI_STRL_SIZE)
+//offset of the 'movi' fourcc from the start of the file
+#define AVI_MOVI_OFFSET (12 + 8 + AVI_HDRL_SIZE + 8)
+
+//RIFF is little endian whatever the host is
+static void Put32(FILE* file, unsigned value)
+{
+	unsigned char bytes[4] = { (unsigned char)value, (unsigned char)(value >> 8), (unsigned char)(value >> 16), (unsigned char)(value >> 24) };
+	fwrite(bytes, 1, 4, file);
+}
+
+static void Put16(FILE* file, unsigned value)
+{
+	unsigned char bytes[2] = { (unsigned char)value, (unsigned char)(value >> 8) };
+	fwrite(bytes, 1, 2, file);
+}
+
+static void PutFourCC(FILE* file, const char* fourcc)
+{
+	fwrite(fourcc, 1, 4, file);
+}
+
+AviWriter::AviWriter(FrameWriter* writer) : OrderedFrameSink(writer)
+{
+
+}
+
+AviWriter::~AviWriter()
+{
+	Close();
+}
+
+bool AviWriter::Open(unsigned width, unsigned height, unsigned framerate, const char* outputPath)
+{
+	m_file = fopen(outputPath, "wb");
+	if (m_file == nullptr)
+		return false;
+
+	m_width = width;
+	m_height = height;
+	m_framerate = framerate;
+	m_largestFrame = 0;
+	m_moviBytes = 4;
+	m_index.clear();
+	WriteHeaders();
+	StartSequencer();
+	return true;
+}
+
+void AviWriter::Close()
+{
+	if (m_file == nullptr)
+		return;
+	StopSequencer();
+
+	PutFourCC(m_file, "idx1");
+	Put32(m_file, (unsigned)m_index.size() * 16);
+	for (const IndexEntry& entry : m_index)
+	{
+		PutFourCC(m_file, "00dc");
+		Put32(m_file, AVIIF_KEYFRAME);
+		Put32(m_file, entry.offset);
+		Put32(m_file, entry.size);
+	}
+
+	//now the frame count and sizes are known rewrite the headers over the placeholders
+	fseek(m_file, 0, SEEK_SET);
+	WriteHeaders();
+	fclose(m_file);
+	m_file = nullptr;
+}
+
+void AviWriter::WriteHeaders()
+{
+	unsigned frames = (unsigned)m_index.size();
+	unsigned indexBytes = 8 + frames * 16;
+	unsigned riffBytes = 4 + 8 + AVI_HDRL_SIZE + 8 + m_moviBytes + indexBytes;
+
+	PutFourCC(m_file, "RIFF");
+	Put32(m_file, riffBytes);
+	PutFourCC(m_file, "AVI ");
+
+	PutFourCC(m_file, "LIST");
+	Put32(m_file, AVI_HDRL_SIZE);
+	PutFourCC(m_file, "hdrl");
+
+	PutFourCC(m_file, "avih");
+	Put32(m_file, AVI_AVIH_SIZE);
+	Put32(m_file, 1000000 / m_framerate);			//microseconds per frame
+	Put32(m_file, m_largestFrame * m_framerate);	//max bytes per second
+	Put32(m_file, 0);								//padding granularity
+	Put32(m_file, AVIF_HASINDEX);
+	Put32(m_file, frames);
+	Put32(m_file, 0);								//initial frames
+	Put32(m_file, 1);								//streams
+	Put32(m_file, m_largestFrame);					//suggested buffer size
+	Put32(m_file, m_width);
+	Put32(m_file, m_height);
+	for (int i = 0; i < 4; ++i)
+		Put32(m_file, 0);
+
+	PutFourCC(m_file, "LIST");
+	Put32(m_file, AVI_STRL_SIZE);
+	PutFourCC(m_file, "strl");
+
+	PutFourCC(m_file, "strh");
+	Put32(m_file, AVI_STRH_SIZE);
+	PutFourCC(m_file, "vids");
+	PutFourCC(m_file, "MJPG");
+	Put32(m_file, 0);								//flags
+	Put16(m_file, 0);								//priority
+	Put16(m_file, 0);								//language
+	Put32(m_file, 0);								//initial frames
+	Put32(m_file, 1);								//scale
+	Put32(m_file, m_framerate);						//rate, frames per second is rate / scale
+	Put32(m_file, 0);								//start
+	Put32(m_file, frames);							//length
+	Put32(m_file, m_largestFrame);					//suggested buffer size
+	Put32(m_file, 0xFFFFFFFF);						//quality, -1 for the default
+	Put32(m_file, 0);								//sample size, 0 as frames vary in size
+	Put16(m_file, 0);								//frame rectangle
+	Put16(m_file, 0);
+	Put16(m_file, m_width);
+	Put16(m_file, m_height);
+
+	//BITMAPINFOHEADER
+	PutFourCC(m_file, "strf");
+	Put32(m_file, AVI_STRF_SIZE);
+	Put32(m_file, AVI_STRF_SIZE);
+	Put32(m_file, m_width);
+	Put32(m_file, m_height);
+	Put16(m_file, 1);								//planes
+	Put16(m_file, 24);								//bits per pixel
+	PutFourCC(m_file, "MJPG");
+	Put32(m_file, m_width * m_height * 3);
+	Put32(m_file, 0);
+	Put32(m_file, 0);
+	Put32(m_file, 0);
+	Put32(m_file, 0);
+
+	PutFourCC(m_file, "LIST");
+	Put32(m_file, m_moviBytes);
+	PutFourCC(m_file, "movi");
+}
+
+void AviWriter::WriteFrameData(int frameIndex, FrameBuffer* buffer)
+{
+	unsigned size = (unsigned)buffer->length;
+	IndexEntry entry;
+	entry.offset = m_moviBytes;
+	entry.size = size;
+
+	PutFourCC(m_file, "00dc");
+	Put32(m_file, size);
+	size_t written = fwrite(buffer->data, 1, size, m_file);
+	//chunks are word aligned
+	if (size & 1)
+		fputc(0, m_file);
+	if (written != size)
+	{
+		std::stringstream outputMsg;
+		outputMsg << "AviWriter: failed to write frame " << frameIndex << std::endl;
+		std::cout << outputMsg.str();
+	}
+
+	m_index.push_back(entry);
+	m_moviBytes += 8 + size + (size & 1);
+	if (size > m_largestFrame)
+		m_largestFrame = size;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "OrderedFrameSink.h"
+#include <cstdio>
+#include <vector>
+
+//Writes already encoded JPEG frames into a Motion JPEG AVI, in frame order. The RIFF sizes and frame
+//counts aren't known until the end, so the headers are written with placeholders and patched on Close.
+class AviWriter : public OrderedFrameSink
+{
+public:
+	AviWriter(FrameWriter* writer);
+	~AviWriter();
+
+	bool Open(unsigned width, unsigned height, unsigned framerate, const char* outputPath);
+	//Writes everything still buffered, then the index, and fixes up the headers
+	void Close();
+
+	bool IsOpen() { return m_file != nullptr; }
+
+protected:
+	void WriteFrameData(int frameIndex, FrameBuffer* buffer) override;
+
+private:
+	void WriteHeaders();
+
+	//one idx1 entry per frame, offsets are relative to the 'movi' fourcc
+	struct IndexEntry
+	{
+		unsigned offset;
+		unsigned size;
+	};
+
+	FILE* m_file = nullptr;
+	unsigned m_width = 0;
+	unsigned m_height = 0;
+	unsigned m_framerate = 0;
+	unsigned m_largestFrame = 0;
+	unsigned m_moviBytes = 0;
+	std::vector<IndexEntry> m_index;
+};
@@ -0,0 +1,527 @@
+#include "FrameArchive.h"
+#include <climits>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#ifdef _WIN32
+#define fseek64 _fseeki64
+#define ftell64 _ftelli64
+#else
+#define fseek64 fseeko
+#define ftell64 ftello
+#endif
+
+static void Put32(unsigned char* p, unsigned value)
+{
+	p[0] = (unsigned char)value;
+	p[1] = (unsigned char)(value >> 8);
+	p[2] = (unsigned char)(value >> 16);
+	p[3] = (unsigned char)(value >> 24);
+}
+
+static void Put64(unsigned char* p, unsigned long long value)
+{
+	Put32(p, (unsigned)value);
+	Put32(p + 4, (unsigned)(value >> 32));
+}
+
+static unsigned Get32(const unsigned char* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned)p[3] << 24);
+}
+
+static unsigned long long Get64(const unsigned char* p)
+{
+	return Get32(p) | ((unsigned long long)Get32(p + 4) << 32);
+}
+
+static bool SamePixel(const unsigned char* a, const unsigned char* b)
+{
+	return a[0] == b[0] && a[1] == b[1] && a[2] == b[2];
+}
+
+void FrameRLE::Encode(const unsigned char* rgb, size_t pixels, std::vector<unsigned char>& out)
+{
+	size_t i = 0;
+	while (i < pixels)
+	{
+		size_t run = 1;
+		while (i + run < pixels && run < 129 && SamePixel(rgb + (i + run) * 3, rgb + i * 3))
+			run++;
+		if (run >= 2)
+		{
+			out.push_back((unsigned char)(run + 126));
+			out.insert(out.end(), rgb + i * 3, rgb + i * 3 + 3);
+			i += run;
+			continue;
+		}
+
+		//gather literals until the next repeat starts
+		size_t literals = 1;
+		while (i + literals < pixels && literals < 128 &&
+			!(i + literals + 1 < pixels && SamePixel(rgb + (i + literals) * 3, rgb + (i + literals + 1) * 3)))
+			literals++;
+		out.push_back((unsigned char)(literals - 1));
+		out.insert(out.end(), rgb + i * 3, rgb + (i + literals) * 3);
+		i += literals;
+	}
+}
+
+bool FrameRLE::Decode(const unsigned char* data, size_t length, unsigned char* rgb, size_t pixels)
+{
+	size_t in = 0;
+	size_t pixel = 0;
+	while (in < length)
+	{
+		unsigned control = data[in++];
+		if (control < 128)
+		{
+			size_t count = control + 1;
+			if (pixel + count > pixels || in + count * 3 > length)
+				return false;
+			memcpy(rgb + pixel * 3, data + in, count * 3);
+			in += count * 3;
+			pixel += count;
+		}
+		else
+		{
+			size_t count = control - 126;
+			if (pixel + count > pixels || in + 3 > length)
+				return false;
+			for (size_t i = 0; i < count; i++, pixel++)
+				memcpy(rgb + pixel * 3, data + in, 3);
+			in += 3;
+		}
+	}
+	return pixel == pixels;
+}
+
+FrameTiles::FrameTiles(unsigned width, unsigned height)
+{
+	m_width = width;
+	m_height = height;
+	m_across = (width + DELTA_TILE_SIZE - 1) / DELTA_TILE_SIZE;
+	m_down = (height + DELTA_TILE_SIZE - 1) / DELTA_TILE_SIZE;
+}
+
+//Tiles on the right and bottom edges are cut down to fit the frame
+void FrameTiles::Bounds(unsigned tile, unsigned& x, unsigned& y, unsigned& w, unsigned& h)
+{
+	x = (tile % m_across) * DELTA_TILE_SIZE;
+	y = (tile / m_across) * DELTA_TILE_SIZE;
+	w = m_width - x < DELTA_TILE_SIZE ? m_width - x : DELTA_TILE_SIZE;
+	h = m_height - y < DELTA_TILE_SIZE ? m_height - y : DELTA_TILE_SIZE;
+}
+
+size_t FrameTiles::GetTileBytes(unsigned tile)
+{
+	unsigned x, y, w, h;
+	Bounds(tile, x, y, w, h);
+	return (size_t)w * h * 3;
+}
+
+size_t FrameTiles::GatherDifference(const unsigned char* rgb, const unsigned char* previous, unsigned tile, unsigned char* out)
+{
+	unsigned x, y, w, h;
+	Bounds(tile, x, y, w, h);
+	for (unsigned row = 0; row < h; row++)
+	{
+		size_t offset = ((size_t)(y + row) * m_width + x) * 3;
+		unsigned char* outRow = out + (size_t)row * w * 3;
+		for (unsigned i = 0; i < w * 3; i++)
+			outRow[i] = (unsigned char)(rgb[offset + i] - previous[offset + i]);
+	}
+	return (size_t)w * h * 3;
+}
+
+size_t FrameTiles::ApplyDifference(const unsigned char* in, unsigned tile, unsigned char* rgb)
+{
+	unsigned x, y, w, h;
+	Bounds(tile, x, y, w, h);
+	for (unsigned row = 0; row < h; row++)
+	{
+		size_t offset = ((size_t)(y + row) * m_width + x) * 3;
+		const unsigned char* inRow = in + (size_t)row * w * 3;
+		for (unsigned i = 0; i < w * 3; i++)
+			rgb[offset + i] = (unsigned char)(rgb[offset + i] + inRow[i]);
+	}
+	return (size_t)w * h * 3;
+}
+
+bool FrameTiles::Differs(const unsigned char* a, const unsigned char* b, unsigned tile)
+{
+	unsigned x, y, w, h;
+	Bounds(tile, x, y, w, h);
+	for (unsigned row = 0; row < h; row++)
+	{
+		size_t offset = ((size_t)(y + row) * m_width + x) * 3;
+		if (memcmp(a + offset, b + offset, w * 3) != 0)
+			return true;
+	}
+	return false;
+}
+
+FrameArchiveWriter::FrameArchiveWriter(FrameWriter* writer) : OrderedFrameSink(writer)
+{
+
+}
+
+FrameArchiveWriter::~FrameArchiveWriter()
+{
+	Close();
+}
+
+bool FrameArchiveWriter::Open(unsigned width, unsigned height, const char* outputPath, int keyframeInterval)
+{
+	m_file = fopen(outputPath, "wb");
+	if (m_file == nullptr)
+		return false;
+
+	m_width = width;
+	m_height = height;
+	m_keyframeInterval = keyframeInterval;
+	m_previousFrame = -1;
+	m_index.clear();
+	WriteHeader(0);
+	m_offset = FRAME_ARCHIVE_HEADER_SIZE;
+	StartSequencer();
+	return true;
+}
+
+void FrameArchiveWriter::Close()
+{
+	if (m_file == nullptr)
+		return;
+	StopSequencer();
+
+	unsigned long long indexOffset = m_offset;
+	unsigned char indexHeader[8];
+	memcpy(indexHeader, "INDX", 4);
+	Put32(indexHeader + 4, (unsigned)m_index.size());
+	fwrite(indexHeader, 1, sizeof(indexHeader), m_file);
+	for (const FrameArchiveEntry& entry : m_index)
+	{
+		unsigned char bytes[16];
+		Put64(bytes, entry.offset);
+		Put32(bytes + 8, entry.size);
+		Put32(bytes + 12, entry.codec);
+		fwrite(bytes, 1, sizeof(bytes), m_file);
+	}
+
+	//the header goes last so a reader only trusts the index once it's completely written
+	fflush(m_file);
+	fseek64(m_file, 0, SEEK_SET);
+	WriteHeader(indexOffset);
+	fclose(m_file);
+	m_file = nullptr;
+}
+
+void FrameArchiveWriter::WriteHeader(unsigned long long indexOffset)
+{
+	unsigned char header[FRAME_ARCHIVE_HEADER_SIZE];
+	memcpy(header, "RTFA", 4);
+	Put32(header + 4, FRAME_ARCHIVE_VERSION);
+	Put32(header + 8, m_width);
+	Put32(header + 12, m_height);
+	Put32(header + 16, (unsigned)m_index.size());
+	Put32(header + 20, 0);
+	Put64(header + 24, indexOffset);
+	fwrite(header, 1, sizeof(header), m_file);
+}
+
+void FrameArchiveWriter::WriteFrameData(int frame, FrameBuffer* buffer)
+{
+	const unsigned char* rgb = (const unsigned char*)buffer->data;
+	FrameArchiveEntry entry;
+	const unsigned char* data = rgb;
+	entry.size = (unsigned)buffer->length;
+
+	m_encoded.clear();
+	FrameRLE::Encode(rgb, (size_t)m_width * m_height, m_encoded);
+	if (m_encoded.size() < buffer->length)
+	{
+		entry.codec = FRAME_CODEC_RLE;
+		entry.size = (unsigned)m_encoded.size();
+		data = m_encoded.data();
+	}
+
+	//a frame can only be a delta of the one straight before it, so a gap forces a keyframe too. When most
+	//of the frame moves the whole frame can code smaller than the delta, then it's kept as a keyframe.
+	bool keyframe = m_keyframeInterval <= 0 || frame % m_keyframeInterval == 0 || m_previousFrame != frame - 1;
+	if (!keyframe)
+	{
+		EncodeDelta(rgb);
+		if (m_delta.size() < entry.size)
+		{
+			entry.codec = FRAME_CODEC_DELTA;
+			entry.size = (unsigned)m_delta.size();
+			data = m_delta.data();
+		}
+	}
+
+	unsigned char record[FRAME_ARCHIVE_RECORD_SIZE];
+	memcpy(record, "FRME", 4);
+	Put32(record + 4, (unsigned)frame);
+	Put32(record + 8, entry.codec);
+	Put32(record + 12, entry.size);
+	entry.offset = m_offset + FRAME_ARCHIVE_RECORD_SIZE;
+	if (fwrite(record, 1, sizeof(record), m_file) != sizeof(record) || fwrite(data, 1, entry.size, m_file) != entry.size)
+	{
+		std::stringstream outputMsg;
+		outputMsg << "FrameArchive: failed to write frame " << frame << std::endl;
+		std::cout << outputMsg.str();
+	}
+	m_offset += FRAME_ARCHIVE_RECORD_SIZE + entry.size;
+
+	if (m_index.size() <= (size_t)frame)
+		m_index.resize(frame + 1);
+	m_index[frame] = entry;
+
+	if (m_keyframeInterval > 0)
+	{
+		m_previous.assign(rgb, rgb + buffer->length);
+		m_previousFrame = frame;
+	}
+}
+
+void FrameArchiveWriter::EncodeDelta(const unsigned char* rgb)
+{
+	FrameTiles tiles(m_width, m_height);
+	m_delta.assign(tiles.GetBitmapBytes(), 0);
+	m_tiles.resize((size_t)m_width * m_height * 3);
+
+	size_t gathered = 0;
+	for (unsigned tile = 0; tile < tiles.GetCount(); tile++)
+	{
+		if (!tiles.Differs(rgb, m_previous.data(), tile))
+			continue;
+		m_delta[tile / 8] |= (unsigned char)(1 << (tile % 8));
+		gathered += tiles.GatherDifference(rgb, m_previous.data(), tile, &m_tiles[gathered]);
+	}
+	FrameRLE::Encode(m_tiles.data(), gathered / 3, m_delta);
+}
+
+FrameArchiveReader::FrameArchiveReader()
+{
+
+}
+
+FrameArchiveReader::~FrameArchiveReader()
+{
+	Close();
+}
+
+bool FrameArchiveReader::Open(const char* path)
+{
+	Close();
+	m_file = fopen(path, "rb");
+	if (m_file == nullptr)
+		return false;
+
+	unsigned char header[FRAME_ARCHIVE_HEADER_SIZE];
+	if (fread(header, 1, sizeof(header), m_file) != sizeof(header) || memcmp(header, "RTFA", 4) != 0 ||
+		Get32(header + 4) > FRAME_ARCHIVE_VERSION)
+	{
+		Close();
+		return false;
+	}
+	m_width = Get32(header + 8);
+	m_height = Get32(header + 12);
+
+	unsigned long long indexOffset = Get64(header + 24);
+	unsigned frameCount = Get32(header + 16);
+	if (indexOffset == 0 || !ReadIndex(indexOffset, frameCount))
+		RebuildIndex(frameCount);
+	return true;
+}
+
+void FrameArchiveReader::Close()
+{
+	if (m_file != nullptr)
+		fclose(m_file);
+	m_file = nullptr;
+	m_index.clear();
+	m_firstFrame = 0;
+	m_cachedFrame = -1;
+}
+
+bool FrameArchiveReader::ReadIndex(unsigned long long indexOffset, unsigned frameCount)
+{
+	fseek64(m_file, 0, SEEK_END);
+	unsigned long long fileSize = ftell64(m_file);
+	unsigned char indexHeader[8];
+	if (fseek64(m_file, indexOffset, SEEK_SET) != 0 || fread(indexHeader, 1, sizeof(indexHeader), m_file) != sizeof(indexHeader) ||
+		memcmp(indexHeader, "INDX", 4) != 0)
+		return false;
+
+	//the index is written with the header's frame count and runs to the end of the file
+	unsigned count = Get32(indexHeader + 4);
+	if (count != frameCount || (unsigned long long)count * 16 > fileSize - indexOffset - sizeof(indexHeader))
+		return false;
+	std::vector<unsigned char> bytes((size_t)count * 16);
+	if (fread(bytes.data(), 1, bytes.size(), m_file) != bytes.size())
+		return false;
+	m_index.resize(count);
+	m_firstFrame = 0;
+	for (unsigned i = 0; i < count; i++)
+	{
+		FrameArchiveEntry& entry = m_index[i];
+		entry.offset = Get64(&bytes[i * 16]);
+		entry.size = Get32(&bytes[i * 16 + 8]);
+		entry.codec = Get32(&bytes[i * 16 + 12]);
+		//frame data sits between the header and the index
+		if (entry.size != 0 && (entry.offset < FRAME_ARCHIVE_HEADER_SIZE + FRAME_ARCHIVE_RECORD_SIZE || entry.offset > indexOffset ||
+			entry.size > indexOffset - entry.offset))
+		{
+			m_index.clear();
+			return false;
+		}
+	}
+	return true;
+}
+
+//No index, so walk the record headers from the start, stopping at the first incomplete one
+void FrameArchiveReader::RebuildIndex(unsigned frameCount)
+{
+	m_index.clear();
+	m_firstFrame = 0;
+	fseek64(m_file, 0, SEEK_END);
+	unsigned long long fileSize = ftell64(m_file);
+	unsigned long long offset = FRAME_ARCHIVE_HEADER_SIZE;
+	unsigned char record[FRAME_ARCHIVE_RECORD_SIZE];
+	while (fseek64(m_file, offset, SEEK_SET) == 0 && fread(record, 1, sizeof(record), m_file) == sizeof(record) &&
+		memcmp(record, "FRME", 4) == 0)
+	{
+		FrameArchiveEntry entry;
+		entry.offset = offset + FRAME_ARCHIVE_RECORD_SIZE;
+		entry.codec = Get32(record + 8);
+		entry.size = Get32(record + 12);
+		if (entry.size > fileSize - entry.offset)
+			break;
+		//records go in one after another in frame order, so anything else means the rest can't be trusted.
+		//A header that got its frame count written bounds them too, an archive cut short has 0 there
+		unsigned frame = Get32(record + 4);
+		if (m_index.empty() ? frame > INT_MAX : frame != (unsigned)m_firstFrame + m_index.size())
+			break;
+		if (frameCount != 0 && frame >= frameCount)
+			break;
+		if (m_index.empty())
+			m_firstFrame = (int)frame;
+		m_index.push_back(entry);
+		offset = entry.offset + entry.size;
+	}
+
+	std::stringstream outputMsg;
+	outputMsg << "FrameArchive: no index, recovered " << m_index.size() << " frames" << std::endl;
+	std::cout << outputMsg.str();
+}
+
+bool FrameArchiveReader::ReadFrame(int frame, std::vector<unsigned char>& rgb)
+{
+	if (m_file == nullptr || !HasFrame(frame))
+		return false;
+
+	//a delta needs the frame before it, so go back to the cached frame or the last keyframe and decode forwards
+	int start = frame;
+	if (start != m_cachedFrame)
+	{
+		while (m_index[start - m_firstFrame].codec == FRAME_CODEC_DELTA && start - 1 != m_cachedFrame)
+		{
+			start--;
+			if (!HasFrame(start))
+				return false;
+		}
+		for (int i = start; i <= frame; i++)
+		{
+			if (!DecodeFrame(i, m_cached))
+			{
+				m_cachedFrame = -1;
+				return false;
+			}
+			m_cachedFrame = i;
+		}
+	}
+	rgb = m_cached;
+	return true;
+}
+
+bool FrameArchiveReader::DecodeFrame(int frame, std::vector<unsigned char>& rgb)
+{
+	const FrameArchiveEntry& entry = m_index[frame - m_firstFrame];
+	size_t pixels = (size_t)m_width * m_height;
+	rgb.resize(pixels * 3);
+	if (fseek64(m_file, entry.offset, SEEK_SET) != 0)
+		return false;
+
+	switch (entry.codec)
+	{
+	case FRAME_CODEC_RAW:
+		return entry.size == rgb.size() && fread(rgb.data(), 1, rgb.size(), m_file) == rgb.size();
+	case FRAME_CODEC_RLE:
+		m_compressed.resize(entry.size);
+		if (fread(m_compressed.data(), 1, entry.size, m_file) != entry.size)
+			return false;
+		return FrameRLE::Decode(m_compressed.data(), entry.size, rgb.data(), pixels);
+	case FRAME_CODEC_DELTA:
+	{
+		FrameTiles tiles(m_width, m_height);
+		m_compressed.resize(entry.size);
+		if (entry.size < tiles.GetBitmapBytes() || fread(m_compressed.data(), 1, entry.size, m_file) != entry.size)
+			return false;
+		const unsigned char* bitmap = m_compressed.data();
+		size_t changedBytes = 0;
+		for (unsigned tile = 0; tile < tiles.GetCount(); tile++)
+		{
+			if (bitmap[tile / 8] & (1 << (tile % 8)))
+				changedBytes += tiles.GetTileBytes(tile);
+		}
+		m_tiles.resize(changedBytes);
+		if (!FrameRLE::Decode(bitmap + tiles.GetBitmapBytes(), entry.size - tiles.GetBitmapBytes(), m_tiles.data(), changedBytes / 3))
+			return false;
+
+		//everything outside the changed tiles is left as the previous frame
+		size_t scattered = 0;
+		for (unsigned tile = 0; tile < tiles.GetCount(); tile++)
+		{
+			if (bitmap[tile / 8] & (1 << (tile % 8)))
+				scattered += tiles.ApplyDifference(&m_tiles[scattered], tile, rgb.data());
+		}
+		return true;
+	}
+	default:
+		return false;
+	}
+}
+
+bool FrameArchiveReader::ExtractPPM(const char* archivePath, const char* outputDir, int frame)
+{
+	FrameArchiveReader reader;
+	if (!reader.Open(archivePath))
+	{
+		std::cout << "Could not open frame archive " << archivePath << std::endl;
+		return false;
+	}
+
+	int first = frame < 0 ? reader.m_firstFrame : frame;
+	int last = frame < 0 ? reader.GetFrameCount() - 1 : frame;
+	std::vector<unsigned char> rgb;
+	bool ok = true;
+	for (int i = first; i <= last; i++)
+	{
+		if (frame < 0 && !reader.HasFrame(i))
+			continue;
+		if (!reader.ReadFrame(i, rgb))
+		{
+			std::cout << "Frame " << i << " is missing from " << archivePath << std::endl;
+			ok = false;
+			continue;
+		}
+		std::string fileName = std::string(outputDir) + "/spheres" + std::to_string(i) + ".ppm";
+		std::ofstream ofs(fileName, std::ios::out | std::ios::binary);
+		ofs << "P6\n" << reader.GetWidth() << " " << reader.GetHeight() << "\n255\n";
+		ofs.write((const char*)rgb.data(), rgb.size());
+	}
+	return ok;
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include "OrderedFrameSink.h"
+#include <cstdio>
+#include <vector>
+
+//Single file animation archive, all integers little endian:
+//	header		"RTFA", version, width, height, frame count, reserved, index offset (64 bit)
+//	records		"FRME", frame index, codec, size, then size bytes of frame data, one after another
+//	index		"INDX", entry count, then per frame its data offset (64 bit), size and codec
+//The index offset stays 0 until the archive is closed, a reader finding that rebuilds the index by
+//walking the records so an archive cut short by a crash still opens.
+#define FRAME_ARCHIVE_VERSION 2
+#define FRAME_ARCHIVE_HEADER_SIZE 32
+#define FRAME_ARCHIVE_RECORD_SIZE 16
+//Delta frames compare the previous frame in square tiles of this many pixels
+#define DELTA_TILE_SIZE 16
+//Frames between keyframes when delta coding, bounding how far back a random seek has to decode
+#define DELTA_KEYFRAME_INTERVAL 25
+
+//How a frame's rgb24 bytes are stored
+enum FrameCodec
+{
+	FRAME_CODEC_RAW = 0,	//width * height * 3 bytes as is
+	FRAME_CODEC_RLE = 1,	//runs of identical pixels, kept only when smaller than raw
+	FRAME_CODEC_DELTA = 2	//bitmap of the tiles that changed since the previous frame, then each of those tiles'
+							//byte differences from the previous frame in bitmap order, run length coded
+};
+
+struct FrameArchiveEntry
+{
+	unsigned long long offset = 0;
+	unsigned size = 0;
+	unsigned codec = FRAME_CODEC_RAW;
+};
+
+//Appends rgb24 frames to one archive file in frame order and writes the index on Close
+class FrameArchiveWriter : public OrderedFrameSink
+{
+public:
+	FrameArchiveWriter(FrameWriter* writer);
+	~FrameArchiveWriter();
+
+	//keyframeInterval 0 stores every frame whole, otherwise frames between keyframes only store changed tiles
+	bool Open(unsigned width, unsigned height, const char* outputPath, int keyframeInterval = 0);
+	//Writes everything still buffered, then the index, and fixes up the header
+	void Close();
+
+	bool IsOpen() { return m_file != nullptr; }
+
+protected:
+	void WriteFrameData(int frameIndex, FrameBuffer* buffer) override;
+
+private:
+	void WriteHeader(unsigned long long indexOffset);
+	//Fills m_delta with a FRAME_CODEC_DELTA payload against m_previous
+	void EncodeDelta(const unsigned char* rgb);
+
+	FILE* m_file = nullptr;
+	unsigned m_width = 0;
+	unsigned m_height = 0;
+	unsigned long long m_offset = 0;
+	std::vector<FrameArchiveEntry> m_index;
+	int m_keyframeInterval = 0;
+	//reused by every frame so the writer thread only allocates while it grows
+	std::vector<unsigned char> m_encoded;
+	std::vector<unsigned char> m_delta;
+	std::vector<unsigned char> m_tiles;
+	//last frame written and its index, what the next delta is taken against
+	std::vector<unsigned char> m_previous;
+	int m_previousFrame = -1;
+};
+
+//Random access to the frames of an archive, any frame is one seek and one read
+class FrameArchiveReader
+{
+public:
+	FrameArchiveReader();
+	~FrameArchiveReader();
+
+	bool Open(const char* path);
+	void Close();
+
+	unsigned GetWidth() { return m_width; }
+	unsigned GetHeight() { return m_height; }
+	//One past the last frame the archive holds
+	int GetFrameCount() { return m_firstFrame + (int)m_index.size(); }
+
+	//Whether frame was ever written, a render of part of an animation leaves the others out
+	bool HasFrame(int frame) { return frame >= m_firstFrame && frame < GetFrameCount() && m_index[frame - m_firstFrame].size != 0; }
+	//Decodes frame into rgb (width * height * 3 bytes), false if it's missing or damaged
+	bool ReadFrame(int frame, std::vector<unsigned char>& rgb);
+
+	//Writes frame, or every frame when it's negative, as outputDir/spheresN.ppm
+	static bool ExtractPPM(const char* archivePath, const char* outputDir, int frame);
+
+private:
+	//Both only trust what fits in the file and the header's frame count, anything else is treated as damage
+	bool ReadIndex(unsigned long long indexOffset, unsigned frameCount);
+	void RebuildIndex(unsigned frameCount);
+	//Decodes frame's own record on top of rgb, which must already hold the previous frame for a delta
+	bool DecodeFrame(int frame, std::vector<unsigned char>& rgb);
+
+	FILE* m_file = nullptr;
+	unsigned m_width = 0;
+	unsigned m_height = 0;
+	//m_index[i] is frame m_firstFrame + i
+	std::vector<FrameArchiveEntry> m_index;
+	int m_firstFrame = 0;
+	std::vector<unsigned char> m_compressed;
+	std::vector<unsigned char> m_tiles;
+	//last frame decoded, so playing forwards through deltas only decodes each frame once
+	std::vector<unsigned char> m_cached;
+	int m_cachedFrame = -1;
+};
+
+//Tile layout shared by the delta encoder and decoder
+class FrameTiles
+{
+public:
+	FrameTiles(unsigned width, unsigned height);
+
+	unsigned GetCount() { return m_across * m_down; }
+	unsigned GetBitmapBytes() { return (GetCount() + 7) / 8; }
+	size_t GetTileBytes(unsigned tile);
+	//Writes tile's bytes minus previous's, row by row, to out and returns how many bytes that was.
+	//Pixels that didn't change become zeros, which run length code down to almost nothing.
+	size_t GatherDifference(const unsigned char* rgb, const unsigned char* previous, unsigned tile, unsigned char* out);
+	//Adds differences written by GatherDifference back onto the previous frame in rgb
+	size_t ApplyDifference(const unsigned char* in, unsigned tile, unsigned char* rgb);
+	bool Differs(const unsigned char* a, const unsigned char* b, unsigned tile);
+
+private:
+	void Bounds(unsigned tile, unsigned& x, unsigned& y, unsigned& w, unsigned& h);
+
+	unsigned m_width;
+	unsigned m_height;
+	unsigned m_across;
+	unsigned m_down;
+};
+
+//Pixel run length coding used by FRAME_CODEC_RLE. Control bytes below 128 are followed by control + 1
+//literal pixels, 128 and above by one pixel repeated control - 126 times.
+class FrameRLE
+{
+public:
+	//Appends the coded pixels to out
+	static void Encode(const unsigned char* rgb, size_t pixels, std::vector<unsigned char>& out);
+	static bool Decode(const unsigned char* data, size_t length, unsigned char* rgb, size_t pixels);
+};
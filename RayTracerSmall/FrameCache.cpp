@@ -0,0 +1,115 @@
+#include "FrameCache.h"
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <thread>
+
+#ifdef _WIN32
+#include <direct.h>
+#define MakeDirectory(path) _mkdir(path)
+#else
+#include <sys/stat.h>
+#define MakeDirectory(path) mkdir(path, 0755)
+#endif
+
+#define FNV_OFFSET_BASIS 14695981039346656037ull
+#define FNV_PRIME 1099511628211ull
+
+static void HashBytes(unsigned long long& hash, const void* data, size_t length)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < length; i++)
+	{
+		hash ^= bytes[i];
+		hash *= FNV_PRIME;
+	}
+}
+
+static void HashFloat(unsigned long long& hash, float value)
+{
+	HashBytes(hash, &value, sizeof(value));
+}
+
+static void HashVec(unsigned long long& hash, const Vec3f& value)
+{
+	HashFloat(hash, value.x);
+	HashFloat(hash, value.y);
+	HashFloat(hash, value.z);
+}
+
+FrameCache::FrameCache(const char* directory)
+{
+	m_directory = directory;
+	MakeDirectory(directory);
+}
+
+unsigned long long FrameCache::Key(const FrameSpheres& scene, const RenderSettings& settings, size_t pixelBytes)
+{
+	unsigned long long hash = FNV_OFFSET_BASIS;
+	unsigned header[5] = { FRAME_CACHE_VERSION, settings.width, settings.height, settings.halfFramebuffer ? 1u : 0u, (unsigned)pixelBytes };
+	HashBytes(hash, header, sizeof(header));
+	HashFloat(hash, settings.fov);
+
+	//field by field so padding or a reordered class can't change the key
+	unsigned count = scene.Size();
+	HashBytes(hash, &count, sizeof(count));
+	for (unsigned i = 0; i < count; i++)
+	{
+		HashVec(hash, scene.GetCenter(i));
+		HashFloat(hash, scene.radius2[i]);
+		HashBytes(hash, &scene.material[i], sizeof(scene.material[i]));
+	}
+	count = (unsigned)scene.materials.size();
+	HashBytes(hash, &count, sizeof(count));
+	for (const Material& material : scene.materials)
+	{
+		HashVec(hash, material.surfaceColor);
+		HashVec(hash, material.emissionColor);
+		HashFloat(hash, material.transparency);
+		HashFloat(hash, material.reflection);
+	}
+	return hash;
+}
+
+std::string FrameCache::PathFor(unsigned long long key)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "/%016llx.frame", key);
+	return m_directory + name;
+}
+
+bool FrameCache::Load(unsigned long long key, char* out, size_t bytes)
+{
+	FILE* file = fopen(PathFor(key).c_str(), "rb");
+	if (file == nullptr)
+	{
+		m_misses++;
+		return false;
+	}
+
+	//one byte extra to tell a truncated or oversized file from an exact match
+	size_t read = fread(out, 1, bytes, file);
+	bool exact = read == bytes && fgetc(file) == EOF;
+	fclose(file);
+	if (exact)
+		m_hits++;
+	else
+		m_misses++;
+	return exact;
+}
+
+void FrameCache::Store(unsigned long long key, const char* data, size_t bytes)
+{
+	std::string path = PathFor(key);
+	std::stringstream temporary;
+	temporary << path << "." << std::this_thread::get_id() << ".tmp";
+
+	FILE* file = fopen(temporary.str().c_str(), "wb");
+	if (file == nullptr)
+		return;
+	bool written = fwrite(data, 1, bytes, file) == bytes;
+	written = fclose(file) == 0 && written;
+	//rename won't replace an existing file on Windows, and there the existing frame is identical anyway
+	if (!written || rename(temporary.str().c_str(), path.c_str()) != 0)
+		remove(temporary.str().c_str());
+}
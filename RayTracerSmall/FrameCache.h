@@ -0,0 +1,38 @@
+#pragma once
+
+#include "FrameSpheres.h"
+#include "RenderSettings.h"
+#include <string>
+#include <vector>
+#include <atomic>
+
+//Bump whenever Trace, the key or the output pixel formats change, so frames cached by an older build are never reused
+#define FRAME_CACHE_VERSION 2
+
+//On disk cache of finished frames keyed by everything that decides their pixels: the sphere state, the
+//camera and the pixel format. A frame whose key is already in the cache is loaded instead of traced.
+class FrameCache
+{
+public:
+	//Creates directory if it doesn't exist yet
+	FrameCache(const char* directory);
+
+	//64 bit FNV-1a of the spheres and materials, the settings that change the image and pixelBytes (which tells rgb24,
+	//PFM and the like apart). fusedQuantize and the output container don't change pixels so aren't included.
+	static unsigned long long Key(const FrameSpheres& scene, const RenderSettings& settings, size_t pixelBytes);
+
+	//Reads the frame straight into out, false on a miss or if the cached file isn't exactly bytes long
+	bool Load(unsigned long long key, char* out, size_t bytes);
+	//Writes to a temporary file and renames it into place, so a reader never sees half a frame
+	void Store(unsigned long long key, const char* data, size_t bytes);
+
+	int GetHits() { return m_hits; }
+	int GetMisses() { return m_misses; }
+
+private:
+	std::string PathFor(unsigned long long key);
+
+	std::string m_directory;
+	std::atomic<int> m_hits{ 0 };
+	std::atomic<int> m_misses{ 0 };
+};
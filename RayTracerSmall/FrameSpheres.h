@@ -0,0 +1,75 @@
+#pragma once
+
+#include "Vec3.h"
+#include <vector>
+#include <cmath>
+
+//How a surface is shaded, shared by every sphere that looks the same
+struct Material
+{
+	Vec3f surfaceColor, emissionColor;      /// surface color and emission (light)
+	float transparency, reflection;         /// surface transparency and reflectivity
+};
+
+//Just what a ray needs to test a sphere, the material is only looked up once the sphere is hit
+struct CompactSphere
+{
+	Vec3f center;
+	float radius2;
+	unsigned material;
+
+	//same geometric solution as Sphere::intersect
+	bool intersect(const Vec3f& rayorig, const Vec3f& raydir, float& t0, float& t1) const
+	{
+		Vec3f l = center - rayorig;
+		float tca = l.dot(raydir);
+		if (tca < 0) return false;
+		float d2 = l.dot(l) - tca * tca;
+		if (d2 > radius2) return false;
+		float thc = sqrt(radius2 - d2);
+		t0 = tca - thc;
+		t1 = tca + thc;
+
+		return true;
+	}
+};
+
+//One frame of a scene as Trace sees it. Sphere state is kept a field to an array so it can be evaluated
+//four spheres at a time and the intersection loop only streams through what it reads.
+struct FrameSpheres
+{
+	std::vector<float> centerX, centerY, centerZ, radius2;
+	std::vector<unsigned> material;
+	std::vector<Material> materials;
+	//spheres whose material emits, in sphere order
+	std::vector<unsigned> lights;
+
+	unsigned Size() const { return (unsigned)material.size(); }
+	void Resize(unsigned count)
+	{
+		centerX.resize(count);
+		centerY.resize(count);
+		centerZ.resize(count);
+		radius2.resize(count);
+		material.resize(count);
+	}
+
+	Vec3f GetCenter(unsigned sphere) const { return Vec3f(centerX[sphere], centerY[sphere], centerZ[sphere]); }
+	CompactSphere GetSphere(unsigned sphere) const { return { GetCenter(sphere), radius2[sphere], material[sphere] }; }
+	const Material& GetMaterial(unsigned sphere) const { return materials[material[sphere]]; }
+
+	//same geometric solution as Sphere::intersect
+	bool Intersect(unsigned sphere, const Vec3f& rayorig, const Vec3f& raydir, float& t0, float& t1) const
+	{
+		Vec3f l = GetCenter(sphere) - rayorig;
+		float tca = l.dot(raydir);
+		if (tca < 0) return false;
+		float d2 = l.dot(l) - tca * tca;
+		if (d2 > radius2[sphere]) return false;
+		float thc = sqrt(radius2[sphere] - d2);
+		t0 = tca - thc;
+		t1 = tca + thc;
+
+		return true;
+	}
+};
@@ -0,0 +1,256 @@
+#include "FrameWriter.h"
+#include <sstream>
+#include <fstream>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#endif
+
+FrameWriter::FrameWriter(Heap* bufferHeap, size_t maxBuffers)
+{
+	m_bufferHeap = bufferHeap;
+	m_maxBuffers = maxBuffers;
+#if FRAME_WRITER_IO_URING
+	ringReady = io_uring_queue_init(FRAME_WRITER_QUEUE_DEPTH, &ring, 0) == 0;
+#endif
+	std::stringstream outputMsg;
+	outputMsg << "Frame writer using " << (UsingIOUring() ? "io_uring" : "blocking writes") << " on a dedicated I/O thread" << std::endl;
+	std::cout << outputMsg.str();
+
+	ioThread = std::thread([this]() { IOThreadFunc(); });
+}
+
+FrameWriter::~FrameWriter()
+{
+	//write out anything still queued before stopping the I/O thread
+	Flush();
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		stopping = true;
+	}
+	queueCV.notify_one();
+	ioThread.join();
+
+#if FRAME_WRITER_IO_URING
+	if (ringReady)
+		io_uring_queue_exit(&ring);
+#endif
+	for (size_t i = 0; i < freeBuffers.size(); i++)
+	{
+		delete[] freeBuffers[i]->data;
+		delete freeBuffers[i];
+	}
+}
+
+FrameBuffer* FrameWriter::AcquireBuffer(size_t bytes)
+{
+	std::unique_lock<std::mutex> lock(freeMutex);
+	freeCV.wait(lock, [this]() { return !freeBuffers.empty() || bufferCount < m_maxBuffers; });
+	for (size_t i = 0; i < freeBuffers.size(); i++)
+	{
+		if (freeBuffers[i]->capacity >= bytes)
+		{
+			FrameBuffer* buffer = freeBuffers[i];
+			freeBuffers[i] = freeBuffers.back();
+			freeBuffers.pop_back();
+			buffer->length = 0;
+			return buffer;
+		}
+	}
+
+	FrameBuffer* buffer;
+	if (bufferCount < m_maxBuffers)
+	{
+		//no recycled buffer is big enough, so make a new one
+		bufferCount++;
+		lock.unlock();
+		buffer = new FrameBuffer();
+	}
+	else
+	{
+		//every buffer is made and the free ones are too small, so one of them grows
+		buffer = freeBuffers.back();
+		freeBuffers.pop_back();
+		lock.unlock();
+		delete[] buffer->data;
+	}
+	buffer->data = new (m_bufferHeap) char[bytes];
+	buffer->capacity = bytes;
+	buffer->length = 0;
+	return buffer;
+}
+
+void FrameWriter::Submit(FrameBuffer* buffer, const std::string& path)
+{
+	buffer->path = path;
+	{
+		std::unique_lock<std::mutex> lock(queueMutex);
+		pendingCV.wait(lock, [this]() { return pending.size() < FRAME_WRITER_MAX_PENDING; });
+		pending.push(buffer);
+		inFlight++;
+	}
+	queueCV.notify_one();
+}
+
+void FrameWriter::ReleaseBuffer(FrameBuffer* buffer)
+{
+	{
+		std::lock_guard<std::mutex> lock(freeMutex);
+		freeBuffers.push_back(buffer);
+	}
+	freeCV.notify_one();
+}
+
+void FrameWriter::Flush()
+{
+	std::unique_lock<std::mutex> lock(queueMutex);
+	flushCV.wait(lock, [this]() { return inFlight == 0; });
+}
+
+void FrameWriter::IOThreadFunc()
+{
+	std::vector<FrameBuffer*> batch;
+	while (true)
+	{
+		{
+			//sleep until there is something to write, then take as much as one submission holds
+			std::unique_lock<std::mutex> lock(queueMutex);
+			queueCV.wait(lock, [this]() { return stopping || !pending.empty(); });
+			if (pending.empty() && stopping)
+				break;
+			while (!pending.empty() && batch.size() < FRAME_WRITER_QUEUE_DEPTH)
+			{
+				batch.push_back(pending.front());
+				pending.pop();
+			}
+		}
+		pendingCV.notify_all();
+
+		WriteBatch(batch);
+
+		for (size_t i = 0; i < batch.size(); i++)
+		{
+			if (batch[i] != nullptr)
+				ReleaseBuffer(batch[i]);
+			else
+			{
+				//written but never handed back, so it no longer counts against the limit
+				{
+					std::lock_guard<std::mutex> lock(freeMutex);
+					bufferCount--;
+				}
+				freeCV.notify_one();
+			}
+		}
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			inFlight -= (int)batch.size();
+		}
+		flushCV.notify_all();
+		batch.clear();
+	}
+}
+
+void FrameWriter::WriteBatch(std::vector<FrameBuffer*>& batch)
+{
+#if FRAME_WRITER_IO_URING
+	if (ringReady)
+	{
+		//open every file, submit all the writes in one go, then reap them
+		int fds[FRAME_WRITER_QUEUE_DEPTH];
+		bool reaped[FRAME_WRITER_QUEUE_DEPTH] = {};
+		size_t submitted = 0;
+		for (size_t i = 0; i < batch.size(); i++)
+		{
+			fds[i] = open(batch[i]->path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			if (fds[i] < 0)
+				continue;
+			io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+			io_uring_prep_write(sqe, fds[i], batch[i]->data, (unsigned)batch[i]->length, 0);
+			io_uring_sqe_set_data(sqe, (void*)(uintptr_t)i);
+			submitted++;
+		}
+		int result = io_uring_submit(&ring);
+		bool inKernel = result >= 0;
+
+		//every submitted write is reaped before its file is closed or its buffer reused
+		size_t reapedCount = 0;
+		while (result >= 0 && reapedCount < submitted)
+		{
+			io_uring_cqe* cqe;
+			result = io_uring_wait_cqe(&ring, &cqe);
+			if (result == -EINTR)
+			{
+				result = 0;
+				continue;
+			}
+			if (result < 0)
+				break;
+			size_t i = (size_t)(uintptr_t)io_uring_cqe_get_data(cqe);
+			//short or failed writes are finished off the slow way
+			if (cqe->res < 0 || (size_t)cqe->res < batch[i]->length)
+				WriteBlocking(batch[i], cqe->res < 0 ? 0 : (size_t)cqe->res);
+			io_uring_cqe_seen(&ring, cqe);
+			reaped[i] = true;
+			reapedCount++;
+		}
+		if (result < 0)
+		{
+			std::stringstream outputMsg;
+			outputMsg << "Frame writer's io_uring failed (" << strerror(-result) << "), " << submitted - reapedCount
+				<< " writes were never reaped. Switching to blocking writes." << std::endl;
+			std::cout << outputMsg.str();
+			io_uring_queue_exit(&ring);
+			ringReady = false;
+		}
+
+		for (size_t i = 0; i < batch.size(); i++)
+		{
+			if (fds[i] >= 0)
+				close(fds[i]);
+			if (reaped[i])
+				continue;
+			WriteBlocking(batch[i], 0);
+			//an unreaped write may still be reading the buffer, so it's never reused
+			if (fds[i] >= 0 && inKernel)
+				batch[i] = nullptr;
+		}
+		return;
+	}
+#endif
+	for (size_t i = 0; i < batch.size(); i++)
+		WriteBlocking(batch[i], 0);
+}
+
+void FrameWriter::WriteBlocking(FrameBuffer* buffer, size_t offset)
+{
+#ifdef _WIN32
+	//offset is only ever non-zero after a short io_uring write, so Windows always writes the whole frame
+	std::ofstream ofs(buffer->path, std::ios::out | std::ios::binary);
+	ofs.write(buffer->data, buffer->length);
+	bool failed = !ofs.good();
+#else
+	int flags = offset == 0 ? O_WRONLY | O_CREAT | O_TRUNC : O_WRONLY;
+	int fd = open(buffer->path.c_str(), flags, 0644);
+	bool failed = fd < 0;
+	while (!failed && offset < buffer->length)
+	{
+		ssize_t written = pwrite(fd, buffer->data + offset, buffer->length - offset, offset);
+		if (written <= 0)
+			failed = true;
+		else
+			offset += written;
+	}
+	if (fd >= 0)
+		close(fd);
+#endif
+	if (failed)
+	{
+		std::stringstream outputMsg;
+		outputMsg << "Frame writer could not write " << buffer->path << std::endl;
+		std::cout << outputMsg.str();
+	}
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "Global.h"
+#include <string>
+#include <vector>
+#include <queue>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+//io_uring is used when the build defines FRAME_WRITER_IO_URING=1 and links liburing (-luring), otherwise
+//the I/O thread falls back to blocking writes
+#ifndef FRAME_WRITER_IO_URING
+#define FRAME_WRITER_IO_URING 0
+#endif
+#if FRAME_WRITER_IO_URING
+#include <liburing.h>
+#endif
+
+//How many writes are handed to io_uring in one submission
+#define FRAME_WRITER_QUEUE_DEPTH 32
+//How many frames can wait for the I/O thread before Submit blocks
+#define FRAME_WRITER_MAX_PENDING 64
+
+//A finished frame's bytes. Owned by the FrameWriter once submitted and recycled after it's written.
+struct FrameBuffer
+{
+	char* data = nullptr;
+	size_t capacity = 0;
+	size_t length = 0;
+	std::string path;
+};
+
+//Writes finished frames on a dedicated I/O thread so render workers never wait on the disk
+class FrameWriter
+{
+public:
+	//No more than maxBuffers buffers are ever made, so a slow disk holds back rendering instead of filling memory
+	FrameWriter(Heap* bufferHeap, size_t maxBuffers);
+	~FrameWriter();
+
+	//Hands out a recycled buffer of at least bytes, or makes a new one. Blocks while every buffer is in use.
+	FrameBuffer* AcquireBuffer(size_t bytes);
+	//Queues buffer->length bytes to be written to path, the writer owns the buffer from here. Blocks while
+	//FRAME_WRITER_MAX_PENDING frames are already waiting.
+	void Submit(FrameBuffer* buffer, const std::string& path);
+	//Gives a buffer back without writing it
+	void ReleaseBuffer(FrameBuffer* buffer);
+	//Blocks until every submitted frame has been written
+	void Flush();
+
+	bool UsingIOUring() { return FRAME_WRITER_IO_URING && ringReady; }
+
+private:
+	void IOThreadFunc();
+	//Writes the batch, setting any buffer the kernel may still be reading from to null so it isn't reused
+	void WriteBatch(std::vector<FrameBuffer*>& batch);
+	void WriteBlocking(FrameBuffer* buffer, size_t offset);
+
+	Heap* m_bufferHeap;
+	std::thread ioThread;
+
+	std::mutex queueMutex;
+	std::condition_variable queueCV;
+	std::condition_variable flushCV;
+	std::condition_variable pendingCV;
+	std::queue<FrameBuffer*> pending;
+	int inFlight = 0;
+	bool stopping = false;
+
+	std::mutex freeMutex;
+	std::condition_variable freeCV;
+	std::vector<FrameBuffer*> freeBuffers;
+	size_t m_maxBuffers;
+	size_t bufferCount = 0;
+
+	bool ringReady = false;
+#if FRAME_WRITER_IO_URING
+	io_uring ring;
+#endif
+};
@@ -1,47 +1,149 @@
 #include "Global.h"
-#include <cassert>
 
-int checkValueHeader = 0xDEADC0DE;
-int checkValFooter = 0XDEADBEEF;
+//Only look up the thread's current heap when the allocator is going to tag blocks with it,
+//otherwise just pass on any scoped heap so mapped heaps still get their allocations
+static Heap* CurrentHeap()
+{
+	if (GlobalAllocator::hasHeader)
+		return HeapDirector::GetCurrentHeap();
+	return HeapDirector::GetScopedHeap();
+}
+
+//Every operator new goes through here so allocation-free regions see all of them
+static void* AllocateFromHeap(size_t size, Heap* pHeap, size_t alignment = 0)
+{
+	if (NoAllocRegion::IsActive())
+		NoAllocRegion::OnAllocation(size);
+	return GlobalAllocator::Allocate(size, pHeap, alignment);
+}
+
+static void* AllocateOrThrow(size_t size, Heap* pHeap, size_t alignment = 0)
+{
+	void* pMem = AllocateFromHeap(size, pHeap, alignment);
+	if (pMem == nullptr)
+		throw std::bad_alloc();
+	return pMem;
+}
 
 void* operator new(size_t size)
 {
-	return ::operator new(size, HeapDirector::GetDefaultHeap());
+	return AllocateOrThrow(size, CurrentHeap());
+}
+
+void* operator new[](size_t size)
+{
+	return AllocateOrThrow(size, CurrentHeap());
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	return AllocateFromHeap(size, CurrentHeap());
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return AllocateFromHeap(size, CurrentHeap());
 }
 
 void* operator new(size_t size, Heap* pHeap)
 {
-	//std::cout << "New function called" << std::endl;
-	size_t nRequestedBytes = size + sizeof(Header) + sizeof(Footer);
-	char* pMem = (char*)malloc(nRequestedBytes);
-	Header* pHeader = (Header*)pMem;
+	return AllocateOrThrow(size, pHeap);
+}
+
+void* operator new[](size_t size, Heap* pHeap)
+{
+	return AllocateOrThrow(size, pHeap);
+}
 
-	pHeader->size = size;
-	pHeader->heap = pHeap;
-	pHeader->checkValue = checkValueHeader;
+void operator delete(void* pMem) noexcept
+{
+	GlobalAllocator::Free(pMem);
+}
 
-	void* pFooterAddr = pMem + sizeof(Header) + size;
-	Footer* pFooter = (Footer*)pFooterAddr;
-	pFooter->checkValue = checkValFooter;
+void operator delete[](void* pMem) noexcept
+{
+	GlobalAllocator::Free(pMem);
+}
 
-	//std::cout << pHeader->size << std::endl;
-	pHeader->heap->Allocate(pHeader->size + sizeof(pHeader) + sizeof(pFooter));
+void operator delete(void* pMem, size_t size) noexcept
+{
+	GlobalAllocator::Free(pMem, 0, size);
+}
 
-	void* pStartMemoryBlock = pMem + sizeof(Header);
-	return pStartMemoryBlock;
+void operator delete[](void* pMem, size_t size) noexcept
+{
+	GlobalAllocator::Free(pMem, 0, size);
 }
 
-void operator delete(void* pMem)
+void operator delete(void* pMem, const std::nothrow_t&) noexcept
 {
-	//std::cout << "Delete function called" << std::endl;
-	Header* pHeader = (Header*)((char*)pMem - sizeof(Header));
-	assert(pHeader->checkValue == checkValueHeader);
+	GlobalAllocator::Free(pMem);
+}
 
-	Footer* pFooter = (Footer*)((char*)pMem + pHeader->size);
-	assert(pFooter->checkValue == checkValFooter);
+void operator delete[](void* pMem, const std::nothrow_t&) noexcept
+{
+	GlobalAllocator::Free(pMem);
+}
 
-	//std::cout << pHeader->size << std::endl;
-	pHeader->heap->DelAllocation(pHeader->size + sizeof(pHeader) + sizeof(pFooter));
+//Only called when a constructor throws during new (pHeap)
+void operator delete(void* pMem, Heap*) noexcept
+{
+	GlobalAllocator::Free(pMem);
+}
 
-	free(pHeader);
-}
\ No newline at end of file
+void operator delete[](void* pMem, Heap*) noexcept
+{
+	GlobalAllocator::Free(pMem);
+}
+
+#ifdef __cpp_aligned_new
+void* operator new(size_t size, std::align_val_t alignment)
+{
+	return AllocateOrThrow(size, CurrentHeap(), (size_t)alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+	return AllocateOrThrow(size, CurrentHeap(), (size_t)alignment);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return AllocateFromHeap(size, CurrentHeap(), (size_t)alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return AllocateFromHeap(size, CurrentHeap(), (size_t)alignment);
+}
+
+void operator delete(void* pMem, std::align_val_t alignment) noexcept
+{
+	GlobalAllocator::Free(pMem, (size_t)alignment);
+}
+
+void operator delete[](void* pMem, std::align_val_t alignment) noexcept
+{
+	GlobalAllocator::Free(pMem, (size_t)alignment);
+}
+
+void operator delete(void* pMem, size_t size, std::align_val_t alignment) noexcept
+{
+	GlobalAllocator::Free(pMem, (size_t)alignment, size);
+}
+
+void operator delete[](void* pMem, size_t size, std::align_val_t alignment) noexcept
+{
+	GlobalAllocator::Free(pMem, (size_t)alignment, size);
+}
+
+void operator delete(void* pMem, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	GlobalAllocator::Free(pMem, (size_t)alignment);
+}
+
+void operator delete[](void* pMem, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	GlobalAllocator::Free(pMem, (size_t)alignment);
+}
+#endif
@@ -1,22 +1,52 @@
 #pragma once
 #include <iostream>
+#include <new>
 #include "Heap.h"
 #include "HeapDirector.h"
+#include "AllocationPolicy.h"
 
-struct Header
-{
-	int size;
-	int checkValue;
-	Heap* heap;
-};
+//Memory debugging (guards, heap tagging and size tracking) is on for debug builds and compiled
+//out for release builds. Define MEMORY_DEBUG as true or false to override.
+#ifndef MEMORY_DEBUG
+#ifdef NDEBUG
+#define MEMORY_DEBUG false
+#else
+#define MEMORY_DEBUG true
+#endif
+#endif
 
-struct Footer
-{
-	int reserve;
-	int checkValue;
-};
+#if MEMORY_DEBUG
+typedef Allocator<GuardCheckPolicy, HeapTagPolicy, SizeTrackPolicy> GlobalAllocator;
+#else
+typedef Allocator<NoGuardCheckPolicy, NoHeapTagPolicy, NoSizeTrackPolicy> GlobalAllocator;
+#endif
+
+#include "NoAllocRegion.h"
 
 void* operator new(size_t size);
+void* operator new[](size_t size);
+void* operator new(size_t size, const std::nothrow_t&) noexcept;
+void* operator new[](size_t size, const std::nothrow_t&) noexcept;
 void* operator new(size_t size, Heap* pHeap);
-void operator delete(void* pMem);
+void* operator new[](size_t size, Heap* pHeap);
+void operator delete(void* pMem) noexcept;
+void operator delete[](void* pMem) noexcept;
+void operator delete(void* pMem, size_t size) noexcept;
+void operator delete[](void* pMem, size_t size) noexcept;
+void operator delete(void* pMem, const std::nothrow_t&) noexcept;
+void operator delete[](void* pMem, const std::nothrow_t&) noexcept;
+void operator delete(void* pMem, Heap* pHeap) noexcept;
+void operator delete[](void* pMem, Heap* pHeap) noexcept;
 
+#ifdef __cpp_aligned_new
+void* operator new(size_t size, std::align_val_t alignment);
+void* operator new[](size_t size, std::align_val_t alignment);
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept;
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept;
+void operator delete(void* pMem, std::align_val_t alignment) noexcept;
+void operator delete[](void* pMem, std::align_val_t alignment) noexcept;
+void operator delete(void* pMem, size_t size, std::align_val_t alignment) noexcept;
+void operator delete[](void* pMem, size_t size, std::align_val_t alignment) noexcept;
+void operator delete(void* pMem, std::align_val_t alignment, const std::nothrow_t&) noexcept;
+void operator delete[](void* pMem, std::align_val_t alignment, const std::nothrow_t&) noexcept;
+#endif
@@ -0,0 +1,92 @@
+#include "HalfFloat.h"
+#include <cstring>
+
+#if HALF_F16C
+#include <immintrin.h>
+#endif
+
+static unsigned FloatBits(float value)
+{
+	unsigned bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+static float BitsFloat(unsigned bits)
+{
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+static unsigned short FloatToHalf(float value)
+{
+	unsigned f = FloatBits(value);
+	unsigned sign = f & 0x80000000u;
+	f ^= sign;
+
+	unsigned short half;
+	if (f >= (127 + 16) << 23)
+	{
+		//too big for a half, or already infinity or NaN
+		half = f > (255u << 23) ? 0x7E00 : 0x7C00;
+	}
+	else if (f < (113 << 23))
+	{
+		//half denormal or zero, adding this magic number makes the FPU do the shift and rounding
+		const float denormMagic = BitsFloat(((127 - 15) + (23 - 10) + 1) << 23);
+		half = (unsigned short)(FloatBits(BitsFloat(f) + denormMagic) - FloatBits(denormMagic));
+	}
+	else
+	{
+		//rebias the exponent and round the mantissa to nearest even
+		unsigned mantissaOdd = (f >> 13) & 1;
+		f += ((unsigned)(15 - 127) << 23) + 0xFFF;
+		f += mantissaOdd;
+		half = (unsigned short)(f >> 13);
+	}
+	return (unsigned short)(half | (sign >> 16));
+}
+
+static float HalfToFloat(unsigned short half)
+{
+	const unsigned shiftedExponent = 0x7C00 << 13;
+	unsigned f = (half & 0x7FFF) << 13;
+	unsigned exponent = shiftedExponent & f;
+	f += (127 - 15) << 23;
+	if (exponent == shiftedExponent)
+	{
+		//infinity or NaN
+		f += (128 - 16) << 23;
+	}
+	else if (exponent == 0)
+	{
+		//denormal, renormalise through the FPU
+		f += 1 << 23;
+		f = FloatBits(BitsFloat(f) - BitsFloat(113 << 23));
+	}
+	f |= (unsigned)(half & 0x8000) << 16;
+	return BitsFloat(f);
+}
+
+void HalfFloat::Pack(const float* in, unsigned short* out, size_t count)
+{
+	size_t i = 0;
+#if HALF_F16C
+	for (; i + 4 <= count; i += 4)
+		_mm_storel_epi64((__m128i*)(out + i), _mm_cvtps_ph(_mm_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT));
+#endif
+	for (; i < count; ++i)
+		out[i] = FloatToHalf(in[i]);
+}
+
+void HalfFloat::Unpack(const unsigned short* in, float* out, size_t count)
+{
+	size_t i = 0;
+#if HALF_F16C
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_ps(out + i, _mm_cvtph_ps(_mm_loadl_epi64((const __m128i*)(in + i))));
+#endif
+	for (; i < count; ++i)
+		out[i] = HalfToFloat(in[i]);
+}
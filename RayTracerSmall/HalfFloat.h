@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+
+//F16C has hardware conversions between float and half, only used when the compiler is targeting it
+#if defined(__F16C__) || defined(__AVX2__)
+#define HALF_F16C 1
+#else
+#define HALF_F16C 0
+#endif
+
+//IEEE 754 binary16 storage for HDR framebuffers, half the size of float with the same range the renderer
+//needs (up to 65504, about three significant decimal digits)
+class HalfFloat
+{
+public:
+	//Rounds to nearest even, values too large for a half become infinity
+	static void Pack(const float* in, unsigned short* out, size_t count);
+	static void Unpack(const unsigned short* in, float* out, size_t count);
+	static bool UsingF16C() { return HALF_F16C != 0; }
+};
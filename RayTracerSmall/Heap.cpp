@@ -1,4 +1,25 @@
 #include "Heap.h"
+#include "Global.h"
+#include <sstream>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+//page size MAP_HUGETLB and transparent huge pages work in
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+//values stored in m_backing
+#define BACKING_MALLOC 0
+#define BACKING_HUGETLB 1
+#define BACKING_THP 2
+#define BACKING_PAGES 3
+
+Heap* Heap::s_mappedHeaps[MAX_MAPPED_HEAPS];
+std::atomic<int> Heap::s_mappedHeapCount{ 0 };
+std::atomic<char*> Heap::s_arenaRegion{ nullptr };
+std::mutex Heap::s_regionMutex;
 
 Heap::Heap(const char* name)
 {
@@ -18,4 +39,286 @@ void Heap::Allocate(size_t size)
 void Heap::DelAllocation(size_t size)
 {
 	allocatedBytes -= size;
-}
\ No newline at end of file
+}
+
+void Heap::AddAllocation(Header* pHeader)
+{
+	std::lock_guard<std::mutex> lock(m_listMutex);
+	pHeader->prev = nullptr;
+	pHeader->next = m_head;
+	if (m_head != nullptr)
+		m_head->prev = pHeader;
+	m_head = pHeader;
+	allocationCount++;
+}
+
+void Heap::RemoveAllocation(Header* pHeader)
+{
+	std::lock_guard<std::mutex> lock(m_listMutex);
+	if (pHeader->prev != nullptr)
+		pHeader->prev->next = pHeader->next;
+	else
+		m_head = pHeader->next;
+	if (pHeader->next != nullptr)
+		pHeader->next->prev = pHeader->prev;
+	allocationCount--;
+}
+
+HeapWalkReport Heap::Walk()
+{
+	//nothing in here may allocate, operator new would try to take m_listMutex again
+	HeapWalkReport report;
+	{
+		std::lock_guard<std::mutex> lock(m_listMutex);
+		for (Header* pHeader = m_head; pHeader != nullptr; pHeader = pHeader->next)
+		{
+			if (!GlobalAllocator::Verify(pHeader))
+			{
+				//a trashed header's next pointer can't be trusted either, so the walk ends here
+				report.corruptBlocks++;
+				break;
+			}
+
+			size_t size = pHeader->size;
+			report.liveBlocks++;
+			report.liveBytes += size;
+
+			int bucket = 0;
+			while (bucket < 31 && ((size_t)2 << bucket) <= size)
+				bucket++;
+			report.sizeBuckets[bucket]++;
+
+			//keep the largest blocks sorted biggest first
+			for (int i = 0; i < HEAP_WALK_LARGEST; i++)
+			{
+				if (size > report.largestBlocks[i])
+				{
+					for (int j = HEAP_WALK_LARGEST - 1; j > i; j--)
+						report.largestBlocks[j] = report.largestBlocks[j - 1];
+					report.largestBlocks[i] = size;
+					break;
+				}
+			}
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(m_arenaMutex);
+	if (m_arenaBase == nullptr)
+		return report;
+	report.arenaFreeBytes = report.arenaLargestFree = m_arenaSize - m_arenaUsed;
+	for (ArenaChunk* pChunk = m_freeChunks; pChunk != nullptr; pChunk = pChunk->nextFree)
+	{
+		report.arenaFreeBytes += pChunk->chunkSize;
+		if (pChunk->chunkSize > report.arenaLargestFree)
+			report.arenaLargestFree = pChunk->chunkSize;
+	}
+	if (report.arenaFreeBytes > 0)
+		report.fragmentation = 1.0f - (float)report.arenaLargestFree / (float)report.arenaFreeBytes;
+	return report;
+}
+
+void Heap::PrintSummary()
+{
+	//read the totals before building the message, the stringstream allocates from this heap too
+	HeapWalkReport report = Walk();
+	size_t bytes = allocatedBytes;
+
+	std::stringstream outputMsg;
+	outputMsg << "Heap: " << m_name << "\n";
+	outputMsg << "\tAllocated bytes: " << bytes << " (" << report.liveBlocks << " live blocks, " << report.liveBytes << " bytes of user data)\n";
+	outputMsg << "\tBacking: " << GetBackingName() << "\n";
+	if (report.corruptBlocks != 0)
+		outputMsg << "\tCorrupt block found, the walk stopped there\n";
+	if (IsMapped())
+		outputMsg << "\tFragmentation: " << report.fragmentation * 100.0f << "% of " << report.arenaFreeBytes << " free arena bytes, largest free " << report.arenaLargestFree << "\n";
+	outputMsg << "\tLargest blocks:";
+	for (int i = 0; i < HEAP_WALK_LARGEST && report.largestBlocks[i] != 0; i++)
+		outputMsg << " " << report.largestBlocks[i];
+	outputMsg << "\n\tSize histogram:";
+	for (int i = 0; i < 32; i++)
+	{
+		if (report.sizeBuckets[i] != 0)
+			outputMsg << " [" << ((size_t)1 << i) << "+]=" << report.sizeBuckets[i];
+	}
+	outputMsg << "\n";
+	std::cout << outputMsg.str();
+}
+
+char* Heap::ReserveArenaRegion()
+{
+	std::lock_guard<std::mutex> lock(s_regionMutex);
+	char* pRegion = s_arenaRegion;
+	if (pRegion != nullptr)
+		return pRegion;
+
+	//address space only, nothing is committed until an arena is mapped into its slot
+	size_t regionSize = MAX_MAPPED_HEAPS * ARENA_SLOT_BYTES;
+#ifdef _WIN32
+	pRegion = (char*)VirtualAlloc(NULL, regionSize, MEM_RESERVE, PAGE_NOACCESS);
+#else
+	//one huge page extra so the slots can start on a huge page boundary, which MAP_HUGETLB needs
+	void* pMem = mmap(NULL, regionSize + HUGE_PAGE_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (pMem != MAP_FAILED)
+		pRegion = (char*)(((uintptr_t)pMem + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+#endif
+	s_arenaRegion.store(pRegion, std::memory_order_release);
+	return pRegion;
+}
+
+bool Heap::MapArena(size_t reserveBytes)
+{
+	std::lock_guard<std::mutex> lock(m_arenaMutex);
+	if (m_arenaBase != nullptr)
+		return true;
+	if (s_mappedHeapCount >= MAX_MAPPED_HEAPS)
+		return false;
+
+	//round up to whole huge pages so the range can be backed by them
+	size_t size = (reserveBytes + HUGE_PAGE_SIZE - 1) & ~(size_t)(HUGE_PAGE_SIZE - 1);
+	if (size > ARENA_SLOT_BYTES)
+		return false;
+	char* pRegion = ReserveArenaRegion();
+	if (pRegion == nullptr)
+		return false;
+	//claim the slot before mapping so two heaps mapping at once can't land in the same one
+	int slot = s_mappedHeapCount.fetch_add(1);
+	if (slot >= MAX_MAPPED_HEAPS)
+		return false;
+	char* pSlot = pRegion + slot * ARENA_SLOT_BYTES;
+
+	void* pMem = nullptr;
+#ifdef _WIN32
+	pMem = VirtualAlloc(pSlot, size, MEM_COMMIT, PAGE_READWRITE);
+	if (pMem != NULL)
+		m_backing = BACKING_PAGES;
+#else
+	//explicit huge pages only work if the system has a hugetlb pool set aside, so try them first
+	//(no MAP_NORESERVE here, an unreserved hugetlb mapping faults with SIGBUS once the pool runs dry)
+	pMem = mmap(pSlot, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_HUGETLB, -1, 0);
+	if (pMem != MAP_FAILED)
+	{
+		m_backing = BACKING_HUGETLB;
+	}
+	else
+	{
+		pMem = mmap(pSlot, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE, -1, 0);
+		if (pMem == MAP_FAILED)
+		{
+			//put the slot back to reserved address space so nothing else gets mapped into the region
+			mmap(pSlot, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_NORESERVE, -1, 0);
+			pMem = nullptr;
+		}
+#ifdef MADV_HUGEPAGE
+		else if (madvise(pMem, size, MADV_HUGEPAGE) == 0)
+			m_backing = BACKING_THP;
+#endif
+		else
+			m_backing = BACKING_PAGES;
+	}
+#endif
+	if (pMem == nullptr)
+		return false;
+
+	m_arenaBase = (char*)pMem;
+	m_arenaSize = size;
+	m_arenaUsed = 0;
+	s_mappedHeaps[slot] = this;
+	return true;
+}
+
+const char* Heap::GetBackingName()
+{
+	switch (m_backing)
+	{
+	case BACKING_HUGETLB:
+		return "huge pages (MAP_HUGETLB)";
+	case BACKING_THP:
+		return "transparent huge pages";
+	case BACKING_PAGES:
+		return "regular pages";
+	default:
+		return "malloc";
+	}
+}
+
+void* Heap::ArenaAlloc(size_t bytes, size_t alignment)
+{
+	if (alignment > ARENA_CHUNK_ALIGN)
+		return nullptr;
+
+	//each chunk is its ArenaChunk record padded out to the chunk alignment, followed by the data
+	size_t chunkSize = ARENA_CHUNK_ALIGN + ((bytes + ARENA_CHUNK_ALIGN - 1) & ~(size_t)(ARENA_CHUNK_ALIGN - 1));
+
+	std::lock_guard<std::mutex> lock(m_arenaMutex);
+	//reuse a freed chunk first, frame buffers come back at the same size every frame
+	ArenaChunk** ppLink = &m_freeChunks;
+	for (ArenaChunk* pChunk = m_freeChunks; pChunk != nullptr; pChunk = pChunk->nextFree)
+	{
+		if (pChunk->chunkSize >= chunkSize)
+		{
+			//hand out the front and keep the rest on the list when it can still hold a chunk of its own
+			if (pChunk->chunkSize - chunkSize >= 2 * ARENA_CHUNK_ALIGN)
+			{
+				ArenaChunk* pRest = (ArenaChunk*)((char*)pChunk + chunkSize);
+				pRest->chunkSize = pChunk->chunkSize - chunkSize;
+				pRest->nextFree = pChunk->nextFree;
+				pChunk->chunkSize = chunkSize;
+				*ppLink = pRest;
+			}
+			else
+			{
+				*ppLink = pChunk->nextFree;
+			}
+			pChunk->nextFree = nullptr;
+			return (char*)pChunk + ARENA_CHUNK_ALIGN;
+		}
+		ppLink = &pChunk->nextFree;
+	}
+
+	if (m_arenaUsed + chunkSize > m_arenaSize)
+		return nullptr;
+	ArenaChunk* pChunk = (ArenaChunk*)(m_arenaBase + m_arenaUsed);
+	m_arenaUsed += chunkSize;
+	pChunk->chunkSize = chunkSize;
+	pChunk->nextFree = nullptr;
+	return (char*)pChunk + ARENA_CHUNK_ALIGN;
+}
+
+void Heap::ArenaFree(void* pMem)
+{
+	ArenaChunk* pChunk = (ArenaChunk*)((char*)pMem - ARENA_CHUNK_ALIGN);
+	std::lock_guard<std::mutex> lock(m_arenaMutex);
+	//the free list is kept in address order so neighbouring chunks can be merged back together
+	ArenaChunk** ppLink = &m_freeChunks;
+	ArenaChunk** ppPrevLink = nullptr;
+	ArenaChunk* pPrev = nullptr;
+	while (*ppLink != nullptr && *ppLink < pChunk)
+	{
+		ppPrevLink = ppLink;
+		pPrev = *ppLink;
+		ppLink = &pPrev->nextFree;
+	}
+
+	ArenaChunk* pNext = *ppLink;
+	if (pNext != nullptr && (char*)pChunk + pChunk->chunkSize == (char*)pNext)
+	{
+		pChunk->chunkSize += pNext->chunkSize;
+		pNext = pNext->nextFree;
+	}
+	pChunk->nextFree = pNext;
+	*ppLink = pChunk;
+	if (pPrev != nullptr && (char*)pPrev + pPrev->chunkSize == (char*)pChunk)
+	{
+		pPrev->chunkSize += pChunk->chunkSize;
+		pPrev->nextFree = pNext;
+		pChunk = pPrev;
+		ppLink = ppPrevLink;
+	}
+
+	//a free chunk at the end of the used range goes back to the bump pointer
+	if ((char*)pChunk + pChunk->chunkSize == m_arenaBase + m_arenaUsed)
+	{
+		m_arenaUsed -= pChunk->chunkSize;
+		*ppLink = nullptr;
+	}
+}
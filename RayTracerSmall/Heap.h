@@ -5,6 +5,40 @@
 #include <stdlib.h>
 #endif
 
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+struct Header;
+
+//How many heaps can be backed by their own mapped arena
+#define MAX_MAPPED_HEAPS 8
+//Alignment of every arena chunk, over-aligned requests bigger than this go to the system allocator
+#define ARENA_CHUNK_ALIGN 64
+//Address space set aside for each mapped heap's arena. Every arena lives in its own slot of one
+//reservation, so finding the heap that owns a pointer is a subtract and a divide
+#define ARENA_SLOT_BYTES ((size_t)1 << (sizeof(void*) == 8 ? 36 : 26))
+
+//How many of the biggest live blocks a heap walk keeps hold of
+#define HEAP_WALK_LARGEST 5
+
+//Snapshot of a heap's live allocations, filled in by Heap::Walk
+struct HeapWalkReport
+{
+	size_t liveBlocks = 0;
+	size_t liveBytes = 0;
+	//1 when the walk stopped at a corrupt header, the blocks after it aren't counted
+	size_t corruptBlocks = 0;
+	//free space inside a mapped arena, the recycled chunks plus the untouched tail
+	size_t arenaFreeBytes = 0;
+	size_t arenaLargestFree = 0;
+	//share of that free space outside the largest free chunk, 0 when any of it can serve one allocation
+	float fragmentation = 0.0f;
+	size_t largestBlocks[HEAP_WALK_LARGEST] = {};
+	//live blocks bucketed by power of two size, bucket i holds sizes in [2^i, 2^(i+1))
+	size_t sizeBuckets[32] = {};
+};
+
 class Heap
 {
 public:
@@ -16,8 +50,59 @@ public:
 	size_t GetSize() { return allocatedBytes; }
 	const char* GetName() { return m_name; }
 
+	void AddAllocation(Header* pHeader);
+	void RemoveAllocation(Header* pHeader);
+	size_t GetAllocationCount() { return allocationCount; }
+
+	HeapWalkReport Walk();
+	void PrintSummary();
+
+	//Backs this heap with one reserved virtual range, preferring explicit huge pages, then
+	//transparent huge pages, then regular pages. Returns false and stays malloc backed on failure.
+	bool MapArena(size_t reserveBytes);
+	bool IsMapped() { return m_arenaBase != nullptr; }
+	const char* GetBackingName();
+	void* ArenaAlloc(size_t bytes, size_t alignment);
+	void ArenaFree(void* pMem);
+
+	//Finds the mapped heap whose arena holds pMem, null for ordinary malloc memory. Runs on every
+	//delete, so it stays inline and constant time
+	static Heap* FindMappedHeap(void* pMem)
+	{
+		uintptr_t region = (uintptr_t)s_arenaRegion.load(std::memory_order_acquire);
+		uintptr_t offset = (uintptr_t)pMem - region;
+		if (region == 0 || offset >= MAX_MAPPED_HEAPS * ARENA_SLOT_BYTES)
+			return nullptr;
+		return s_mappedHeaps[offset / ARENA_SLOT_BYTES];
+	}
+
 private:
-	size_t allocatedBytes = 0;
+	//updated from every thread that allocates, so kept atomic
+	std::atomic<size_t> allocatedBytes{ 0 };
 	const char* m_name = "Heap";
-};
 
+	//head of the intrusive list of live blocks, threaded through each block's Header
+	Header* m_head = nullptr;
+	size_t allocationCount = 0;
+	std::mutex m_listMutex;
+
+	//mapped arena, carved up by a bump pointer with freed chunks kept on an address ordered first-fit list,
+	//split when a request only needs part of one and merged with their neighbours when freed
+	struct ArenaChunk
+	{
+		size_t chunkSize;
+		ArenaChunk* nextFree;
+	};
+	char* m_arenaBase = nullptr;
+	size_t m_arenaSize = 0;
+	size_t m_arenaUsed = 0;
+	ArenaChunk* m_freeChunks = nullptr;
+	int m_backing = 0;
+	std::mutex m_arenaMutex;
+
+	static char* ReserveArenaRegion();
+	static Heap* s_mappedHeaps[MAX_MAPPED_HEAPS];
+	static std::atomic<char*> s_arenaRegion;
+	static std::mutex s_regionMutex;
+	static std::atomic<int> s_mappedHeapCount;
+};
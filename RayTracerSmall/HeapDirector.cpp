@@ -3,9 +3,31 @@
 #include <iostream>
 #include <vector>
 #include <sstream>
+#include <new>
+#include <cstring>
 
 std::vector<Heap*> HeapDirector::heaps;
+std::unordered_map<const char*, Heap*, HeapNameHash, HeapNameEqual> HeapDirector::heapLookup;
+std::mutex HeapDirector::m_heapMutex;
 Heap* HeapDirector::m_defaultHeap;
+thread_local Heap* HeapDirector::m_currentHeap = nullptr;
+
+size_t HeapNameHash::operator()(const char* name) const
+{
+	//FNV-1a over the characters of the name
+	size_t hash = 14695981039346656037ull;
+	for (; *name != '\0'; name++)
+	{
+		hash ^= (unsigned char)*name;
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+bool HeapNameEqual::operator()(const char* a, const char* b) const
+{
+	return strcmp(a, b) == 0;
+}
 
 HeapDirector::HeapDirector()
 {
@@ -16,17 +38,20 @@ HeapDirector::~HeapDirector()
 {
 	//delete everything in the heaps vector
 	heaps.clear();
+	heapLookup.clear();
 }
 
 Heap* HeapDirector::CreateHeap(const char* name)
 {
+	std::lock_guard<std::mutex> lock(m_heapMutex);
 	//If a heap already exists, a new one isn't created
-	Heap* heap = GetHeap(name);
-	if (heap == nullptr);
+	Heap* heap = FindHeap(name);
+	if (heap == nullptr)
 	{
 		//create a new heap and push it onto the heaps vector and output that the heap has been created
 		heap = new Heap(name);
 		heaps.push_back(heap);
+		heapLookup[heap->GetName()] = heap;
 		std::stringstream outputMsg;
 		outputMsg << "Heap created: " << name << std::endl;
 		std::cout << outputMsg.str();
@@ -35,11 +60,31 @@ Heap* HeapDirector::CreateHeap(const char* name)
 	return heap;
 }
 
+Heap* HeapDirector::CreateMappedHeap(const char* name, size_t reserveBytes)
+{
+	Heap* heap = CreateHeap(name);
+	bool wasMapped = heap->IsMapped();
+	if (!heap->MapArena(reserveBytes))
+	{
+		std::stringstream outputMsg;
+		outputMsg << "Heap: " << name << " could not map an arena, falling back to malloc" << std::endl;
+		std::cout << outputMsg.str();
+	}
+	else if (!wasMapped)
+	{
+		std::stringstream outputMsg;
+		outputMsg << "Heap: " << name << " mapped with " << heap->GetBackingName() << std::endl;
+		std::cout << outputMsg.str();
+	}
+	return heap;
+}
+
 void HeapDirector::CreateDefaultHeap()
 {
 	if (m_defaultHeap == nullptr)
 	{
-		m_defaultHeap = (Heap*)malloc(sizeof(Heap));
+		//construct in malloc'd memory so creating the default heap doesn't recurse into operator new
+		m_defaultHeap = new (malloc(sizeof(Heap))) Heap("Default");
 		std::stringstream outputMsg;
 		outputMsg << "Default Heap created: " << std::endl;
 		std::cout << outputMsg.str();
@@ -49,27 +94,17 @@ void HeapDirector::CreateDefaultHeap()
 
 Heap* HeapDirector::GetHeap(const char* name)
 {
-	std::stringstream outputMsg;
-	//iterate through all heaps
-	for (int i = 0; i < heaps.size(); i++)
-	{
-		//check if the current heap exists
-		if (heaps[i] != NULL)
-		{
-			//if the current heap name matches the one searched for
-			if (heaps[i]->GetName() == name)
-			{
-				//output that the heap has been found and return the selected heap
-				outputMsg << "Found Heap: " << name << std::endl;
-				std::cout << outputMsg.str();
-				return heaps[i];
-			}
-		}
-	}
+	std::lock_guard<std::mutex> lock(m_heapMutex);
+	return FindHeap(name);
+}
+
+Heap* HeapDirector::FindHeap(const char* name)
+{
 	//if the heap hasn't been found then return a null pointer
-	outputMsg << "Heap: " << name << " has not been found" << std::endl;
-	std::cout << outputMsg.str();
-	return nullptr;
+	auto found = heapLookup.find(name);
+	if (found == heapLookup.end())
+		return nullptr;
+	return found->second;
 }
 
 Heap* HeapDirector::GetDefaultHeap()
@@ -81,4 +116,54 @@ Heap* HeapDirector::GetDefaultHeap()
 	}
 	//return the default heap
 	return m_defaultHeap;
+}
+
+Heap* HeapDirector::GetCurrentHeap()
+{
+	//fall back to the default heap when no scope is active on this thread
+	if (m_currentHeap != nullptr)
+		return m_currentHeap;
+	return GetDefaultHeap();
+}
+
+HeapWalkReport HeapDirector::WalkHeap(const char* name)
+{
+	Heap* heap = GetHeap(name);
+	if (heap == nullptr)
+		return HeapWalkReport();
+	return heap->Walk();
+}
+
+HeapWalkReport HeapDirector::WalkHeap(Heap* heap)
+{
+	return heap->Walk();
+}
+
+void HeapDirector::DumpHeaps()
+{
+	//output a summary of the default heap followed by every named heap
+	GetDefaultHeap()->PrintSummary();
+	std::lock_guard<std::mutex> lock(m_heapMutex);
+	for (size_t i = 0; i < heaps.size(); i++)
+	{
+		if (heaps[i] != NULL)
+			heaps[i]->PrintSummary();
+	}
+}
+
+HeapScope::HeapScope(Heap* heap)
+{
+	m_previousHeap = HeapDirector::m_currentHeap;
+	HeapDirector::m_currentHeap = heap;
+}
+
+HeapScope::HeapScope(const char* name)
+{
+	m_previousHeap = HeapDirector::m_currentHeap;
+	HeapDirector::m_currentHeap = HeapDirector::CreateHeap(name);
+}
+
+HeapScope::~HeapScope()
+{
+	HeapDirector::m_currentHeap = m_previousHeap;
 }
\ No newline at end of file
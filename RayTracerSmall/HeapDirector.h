@@ -1,8 +1,20 @@
 #pragma once
 
 #include <vector>
+#include <unordered_map>
+#include <mutex>
+#include "Heap.h"
 
-class Heap;
+//Hashes heap names by their contents rather than their pointer, so two copies of "JSON" find the same heap
+struct HeapNameHash
+{
+	size_t operator()(const char* name) const;
+};
+
+struct HeapNameEqual
+{
+	bool operator()(const char* a, const char* b) const;
+};
 
 class HeapDirector
 {
@@ -10,11 +22,38 @@ public:
 	HeapDirector();
 	~HeapDirector();
 	static Heap* CreateHeap(const char* name);
+	static Heap* CreateMappedHeap(const char* name, size_t reserveBytes);
 	static void CreateDefaultHeap();
 	static Heap* GetHeap(const char* name);
 	static Heap* GetDefaultHeap();
+	static Heap* GetCurrentHeap();
+	static Heap* GetScopedHeap() { return m_currentHeap; }
+	static HeapWalkReport WalkHeap(const char* name);
+	static HeapWalkReport WalkHeap(Heap* heap);
+	static void DumpHeaps();
 private:
+	friend class HeapScope;
+
+	static Heap* FindHeap(const char* name);
+
 	static std::vector<Heap*> heaps;
+	static std::unordered_map<const char*, Heap*, HeapNameHash, HeapNameEqual> heapLookup;
+	static std::mutex m_heapMutex;
 	static Heap* m_defaultHeap;
+	//heap that plain operator new uses on this thread, null means the default heap
+	static thread_local Heap* m_currentHeap;
 };
 
+//Redirects plain operator new on the current thread to the given heap until the scope ends
+class HeapScope
+{
+public:
+	HeapScope(Heap* heap);
+	HeapScope(const char* name);
+	~HeapScope();
+
+	HeapScope(const HeapScope&) = delete;
+	HeapScope& operator=(const HeapScope&) = delete;
+private:
+	Heap* m_previousHeap;
+};
@@ -1,28 +1,86 @@
 #include "JSONReader.h"
+#include "ThreadPool.h"
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <unordered_map>
+
+#if EVALUATE_SSE2
+#include <emmintrin.h>
+#endif
 
 ReadSphere::ReadSphere(int count, int frames)
 {
 	sphereAmount = count;
 	frameCount = frames;
-	spheres = new Sphere[sphereAmount];
-	endPos = new Vec3f[sphereAmount];
-	movement = new Vec3f[sphereAmount];
-	endColours = new Vec3f[sphereAmount];
-	colourChange = new Vec3f[sphereAmount];
-	endRad = new float[sphereAmount];
-	radChange = new float[sphereAmount];
+	//the scene arrays go in a mapped heap so large scenes sit on huge pages
+	size_t sceneBytes = (size_t)sphereAmount * (sizeof(Sphere) + 5 * sizeof(Vec3f) + 9 * sizeof(float) + sizeof(Material) + sizeof(unsigned) +
+		17 * (GlobalAllocator::overhead + ARENA_CHUNK_ALIGN));
+	sceneHeap = HeapDirector::CreateMappedHeap("Scene", std::max(sceneBytes * 2, (size_t)SCENE_ARENA_MIN));
+	spheres = new (sceneHeap) Sphere[sphereAmount];
+	endPos = new (sceneHeap) Vec3f[sphereAmount];
+	movement = new (sceneHeap) Vec3f[sphereAmount];
+	endColours = new (sceneHeap) Vec3f[sphereAmount];
+	colourChange = new (sceneHeap) Vec3f[sphereAmount];
+	endRad = new (sceneHeap) float[sphereAmount];
+	radChange = new (sceneHeap) float[sphereAmount];
+	//there can't be more materials than spheres
+	materialAmount = 0;
+	materials = new (sceneHeap) Material[sphereAmount];
+	materialColourChange = new (sceneHeap) Vec3f[sphereAmount];
+	sphereMaterial = new (sceneHeap) unsigned[sphereAmount];
+	startX = new (sceneHeap) float[sphereAmount];
+	startY = new (sceneHeap) float[sphereAmount];
+	startZ = new (sceneHeap) float[sphereAmount];
+	moveX = new (sceneHeap) float[sphereAmount];
+	moveY = new (sceneHeap) float[sphereAmount];
+	moveZ = new (sceneHeap) float[sphereAmount];
+	startRadius = new (sceneHeap) float[sphereAmount];
+	trackAmount = 0;
+	tracks = nullptr;
+	keyAmount = 0;
+	keys = nullptr;
+	mapping = nullptr;
+}
 
+ReadSphere::ReadSphere(int count, int frames, MappedFile* file)
+{
+	sphereAmount = count;
+	frameCount = frames;
+	trackAmount = 0;
+	tracks = nullptr;
+	keyAmount = 0;
+	keys = nullptr;
+	mapping = file;
+	sceneHeap = nullptr;
 }
 
 ReadSphere::~ReadSphere()
 {
-	delete(spheres);
-	delete(endPos);
-	delete(movement);
-	delete(endColours);
-	delete(colourChange);
-	delete(endRad);
-	delete(radChange);
+	if (mapping != nullptr)
+	{
+		delete mapping;
+		return;
+	}
+	delete[] spheres;
+	delete[] endPos;
+	delete[] movement;
+	delete[] endColours;
+	delete[] colourChange;
+	delete[] endRad;
+	delete[] radChange;
+	delete[] materials;
+	delete[] materialColourChange;
+	delete[] sphereMaterial;
+	delete[] startX;
+	delete[] startY;
+	delete[] startZ;
+	delete[] moveX;
+	delete[] moveY;
+	delete[] moveZ;
+	delete[] startRadius;
+	delete[] tracks;
+	delete[] keys;
 }
 
 void ReadSphere::CalcMovement()
@@ -60,130 +118,606 @@ void ReadSphere::CalcRadiusChange()
 	}
 }
 
-ReadSphere* JSONReader::LoadJSON(const char* path)
+void ReadSphere::SetTracks(const std::vector<KeyTrack>& sceneTracks, const std::vector<Keyframe>& sceneKeys)
 {
-	//attempt to read the file, if the file does not exist then output saying so and return null
-	std::fstream file(path);
-	if (!file.good())
-	{
-		std::cout << "Unable to load file: " << path << std::endl;
-		return nullptr;
-	}
-	json f;
-	file >> f;
-	int sphereCount = 0;
-	int frameCount = 0;
-	//Check if the json file specified in path contains a sphere amount and the frame count, if it doesn't find either then null is returned and an output is given
-	if (f.contains("sphereAmount"))
+	delete[] tracks;
+	delete[] keys;
+	trackAmount = 0;
+	for (const KeyTrack& track : sceneTracks)
 	{
-		sphereCount = f["sphereAmount"];
+		if (track.sphere < (unsigned)sphereAmount)
+			trackAmount++;
 	}
-	else
+	keyAmount = (int)sceneKeys.size();
+	tracks = trackAmount > 0 ? new (sceneHeap) KeyTrack[trackAmount] : nullptr;
+	keys = keyAmount > 0 ? new (sceneHeap) Keyframe[keyAmount] : nullptr;
+	//tracks are in sphere order, so the ones kept are the first trackAmount
+	if (trackAmount > 0)
+		memcpy(tracks, sceneTracks.data(), trackAmount * sizeof(KeyTrack));
+	if (keyAmount > 0)
+		memcpy(keys, sceneKeys.data(), keyAmount * sizeof(Keyframe));
+}
+
+//Fields a sphere object can have, in the order they're stored
+enum SphereField
+{
+	FIELD_NONE = -1,
+	FIELD_START_POS,
+	FIELD_END_POS,
+	FIELD_START_RADIUS,
+	FIELD_END_RADIUS,
+	FIELD_SURFACE_COLOUR,
+	FIELD_END_COLOUR,
+	FIELD_REFLECTION,
+	FIELD_TRANSPARENCY,
+	FIELD_EMISSION_COLOUR,
+	FIELD_COUNT
+};
+
+static const char* s_fieldNames[FIELD_COUNT] =
+{
+	"startPos", "endPos", "startRadius", "endRadius", "surfaceColor", "endColour", "reflection", "transparency", "emissionColor"
+};
+
+//Every field but endRadius and emissionColor (only lights have one) has to be given
+#define REQUIRED_FIELDS (((1 << FIELD_COUNT) - 1) & ~(1 << FIELD_END_RADIUS) & ~(1 << FIELD_EMISSION_COLOUR))
+
+//Fields a keyframe object can have
+enum KeyField
+{
+	KEY_NONE = -1,
+	KEY_FRAME,
+	KEY_VALUE,
+	KEY_EASE
+};
+
+//Start and end fields a track's first and last keys fill in, by TrackProperty
+static const SphereField s_trackFields[TRACK_PROPERTY_COUNT][2] =
+{
+	{ FIELD_START_POS, FIELD_END_POS }, { FIELD_START_RADIUS, FIELD_END_RADIUS }, { FIELD_SURFACE_COLOUR, FIELD_END_COLOUR }
+};
+
+//One sphere as it's parsed, vectors are three consecutive values
+struct SphereValues
+{
+	float values[FIELD_COUNT][3];
+	int present;
+};
+
+//Streams the file through nlohmann's SAX parser and writes each sphere into the ReadSphere arrays as soon as
+//its object closes, so no DOM is ever built. Only when "spheres" comes before "sphereAmount" are the spheres
+//held back until the count is known.
+class SceneSaxHandler : public json::json_sax_t
+{
+public:
+	ReadSphere* scene = nullptr;
+	int sphereCount = -1;
+	int frameCount = -1;
+	int spheresRead = 0;
+	bool failed = false;
+	std::vector<SphereValues> pending;
+	//keyframe tracks of every sphere so far, handed to the ReadSphere once the file is read
+	std::vector<KeyTrack> tracks;
+	std::vector<Keyframe> keys;
+
+	bool null() override { return Value(0); }
+	bool boolean(bool val) override { return Value(val ? 1.0f : 0.0f); }
+	bool number_integer(number_integer_t val) override { return Value((float)val); }
+	bool number_unsigned(number_unsigned_t val) override { return Value((float)val); }
+	bool number_float(number_float_t val, const string_t&) override { return Value((float)val); }
+	bool string(string_t& val) override
 	{
-		std::cout << "JSONReader could not find 'sphereAmount' in the JSON File." << std::endl;
-		return nullptr;
+		if (depth == 5 && track >= 0 && keyField == KEY_EASE)
+		{
+			KeyCurve curve;
+			if (!Keyframes::ParseCurve(val.c_str(), curve))
+			{
+				std::cout << "JSONReader: unknown ease \"" << val << "\"" << std::endl;
+				failed = true;
+				return false;
+			}
+			currentKey.curve = curve;
+			return true;
+		}
+		//a quoted frame or value would otherwise read as 0
+		if (track >= 0 && ((depth == 5 && (keyField == KEY_FRAME || keyField == KEY_VALUE)) || (depth == 6 && keyField == KEY_VALUE)))
+		{
+			std::cout << "JSONReader: a keyframe's frame and value must be numbers, not \"" << val << "\"" << std::endl;
+			failed = true;
+			return false;
+		}
+		return Value(0);
 	}
+	bool binary(binary_t&) override { return Value(0); }
 
-	if (f.contains("frameCount"))
+	bool start_object(std::size_t) override
 	{
-		frameCount = f["frameCount"];
+		depth++;
+		//a sphere inside the spheres array
+		if (depth == 3 && inSpheres)
+		{
+			memset(&current, 0, sizeof(current));
+			field = FIELD_NONE;
+			track = -1;
+			tracksRead = 0;
+		}
+		//a keyframe inside one of its tracks
+		else if (depth == 5 && track >= 0)
+		{
+			currentKey = { 0, Vec3f(0), CURVE_LINEAR };
+			keyField = KEY_NONE;
+			keyPresent = 0;
+		}
+		return true;
 	}
-	else
+
+	bool end_object() override
 	{
-		std::cout << "JSONReader could not find 'frameCount' in the JSON File." << std::endl;
-		return nullptr;
+		if (depth == 3 && inSpheres && !StoreSphere())
+			return false;
+		if (depth == 5 && track >= 0)
+		{
+			if (keyPresent != ((1 << KEY_FRAME) | (1 << KEY_VALUE)))
+			{
+				std::cout << "JSONReader: a keyframe needs a frame and a value" << std::endl;
+				failed = true;
+				return false;
+			}
+			keys.push_back(currentKey);
+		}
+		depth--;
+		return true;
 	}
 
-	ReadSphere* sphereInfo = new ReadSphere(sphereCount, frameCount);
-	json spheres = f["spheres"];
-	for (int i = 0; i < sphereCount; i++)
+	bool start_array(std::size_t) override
 	{
-		json sphere = spheres[i];
-		bool failed = false;
-		if (sphere.contains("startPos"))
+		depth++;
+		component = 0;
+		if (depth == 2 && topKey == "spheres")
 		{
-			std::vector<float> start = sphere["startPos"];
-			sphereInfo->spheres[i].center = Vec3f(start[0], start[1], start[2]);
+			inSpheres = true;
+			if (sphereCount >= 0)
+				scene = new ReadSphere(sphereCount, frameCount);
 		}
-		else
-			failed = true;
+		else if (depth == 4 && inSpheres && track >= 0)
+			trackFirst = (unsigned)keys.size();
+		return true;
+	}
+
+	bool end_array() override
+	{
+		if (depth == 2)
+			inSpheres = false;
+		//a finished vector counts as its field
+		else if (depth == 4 && inSpheres && field != FIELD_NONE)
+			current.present |= 1 << field;
+		else if (depth == 4 && inSpheres && track >= 0 && !StoreTrack())
+			return false;
+		else if (depth == 6 && track >= 0 && keyField == KEY_VALUE)
+			keyPresent |= 1 << KEY_VALUE;
+		depth--;
+		return true;
+	}
 
-		if (sphere.contains("endPos"))
+	bool key(string_t& val) override
+	{
+		if (depth == 1)
+			topKey = val;
+		else if (depth == 3 && inSpheres)
 		{
-			std::vector<float> end = sphere["endPos"];
-			sphereInfo->endPos[i] = Vec3f(end[0], end[1], end[2]);
+			field = FIELD_NONE;
+			for (int i = 0; i < FIELD_COUNT; i++)
+			{
+				if (val == s_fieldNames[i])
+					field = (SphereField)i;
+			}
+			track = -1;
+			for (int i = 0; i < TRACK_PROPERTY_COUNT; i++)
+			{
+				if (val == Keyframes::TrackName(i))
+					track = i;
+			}
 		}
-		else
-			failed = true;
+		else if (depth == 5 && track >= 0)
+			keyField = val == "frame" ? KEY_FRAME : val == "value" ? KEY_VALUE : val == "ease" ? KEY_EASE : KEY_NONE;
+		return true;
+	}
+
+	bool parse_error(std::size_t position, const std::string&, const nlohmann::detail::exception& ex) override
+	{
+		std::stringstream msg;
+		msg << "JSONReader: parse error at byte " << position << ": " << ex.what() << "\n";
+		std::cout << msg.str();
+		return false;
+	}
 
-		if (sphere.contains("startRadius"))
+private:
+	bool Value(float value)
+	{
+		if (depth == 1 && topKey == "sphereAmount")
+			sphereCount = (int)value;
+		else if (depth == 1 && topKey == "frameCount")
+			frameCount = (int)value;
+		else if (depth == 3 && inSpheres && field != FIELD_NONE)
 		{
-			float radius = sphere["startRadius"];
-			sphereInfo->spheres[i].radius = radius;
-			sphereInfo->spheres[i].radius2 = radius * radius;
+			current.values[field][0] = value;
+			current.present |= 1 << field;
 		}
-		else
-			failed = true;
-
-		if (sphere.contains("endRadius"))
+		else if (depth == 4 && inSpheres && field != FIELD_NONE && component < 3)
+			current.values[field][component++] = value;
+		else if (depth == 5 && track >= 0 && keyField == KEY_FRAME)
 		{
-			float radius = sphere["endRadius"];
-			sphereInfo->endRad[i] = radius;
+			currentKey.frame = value;
+			keyPresent |= 1 << KEY_FRAME;
 		}
-		else
+		//radius keys are a single number, the others a vector
+		else if (depth == 5 && track >= 0 && keyField == KEY_VALUE)
 		{
-			sphereInfo->endRad[i] = sphereInfo->spheres[i].radius;
+			currentKey.value.x = value;
+			keyPresent |= 1 << KEY_VALUE;
 		}
+		else if (depth == 6 && track >= 0 && keyField == KEY_VALUE && component < 3)
+			(&currentKey.value.x)[component++] = value;
+		return true;
+	}
 
-		if (sphere.contains("surfaceColor"))
+	//A finished track. Its first and last keys stand in for the sphere's start and end values, which is what
+	//the linear animation, materials and exports see.
+	bool StoreTrack()
+	{
+		if (tracksRead & (1 << track))
 		{
-			std::vector<float> surfaceCol = sphere["surfaceColor"];
-			sphereInfo->spheres[i].surfaceColor = Vec3f(surfaceCol[0], surfaceCol[1], surfaceCol[2]);
-		}
-		else
+			std::cout << "JSONReader: a sphere can only have one \"" << Keyframes::TrackName(track) << "\"" << std::endl;
 			failed = true;
-
-		if (sphere.contains("reflection"))
+			return false;
+		}
+		tracksRead |= 1 << track;
+		unsigned count = (unsigned)keys.size() - trackFirst;
+		if (count == 0)
+			return true;
+		for (unsigned i = trackFirst + 1; i < keys.size(); i++)
 		{
-			float reflection = sphere["reflection"];
-			sphereInfo->spheres[i].reflection = reflection;
+			if (keys[i].frame <= keys[i - 1].frame)
+			{
+				std::cout << "JSONReader: keyframes must be in increasing frame order" << std::endl;
+				failed = true;
+				return false;
+			}
 		}
-		else
-			failed = true;
+		tracks.push_back({ (unsigned)spheresRead, (unsigned)track, trackFirst, count });
+		const Vec3f& first = keys[trackFirst].value;
+		const Vec3f& last = keys.back().value;
+		SphereField startField = s_trackFields[track][0];
+		SphereField endField = s_trackFields[track][1];
+		current.values[startField][0] = first.x;
+		current.values[startField][1] = first.y;
+		current.values[startField][2] = first.z;
+		current.values[endField][0] = last.x;
+		current.values[endField][1] = last.y;
+		current.values[endField][2] = last.z;
+		current.present |= (1 << startField) | (1 << endField);
+		return true;
+	}
 
-		if (sphere.contains("transparency"))
+	bool StoreSphere()
+	{
+		if ((current.present & REQUIRED_FIELDS) != REQUIRED_FIELDS)
 		{
-			float transparency = sphere["transparency"];
-			sphereInfo->spheres[i].transparency = transparency;
-		}
-		else
+			std::cout << "JSONReader: Values missing from file!" << std::endl;
 			failed = true;
+			return false;
+		}
+		if (scene == nullptr)
+			pending.push_back(current);
+		else if (spheresRead < sphereCount)
+			Store(scene, spheresRead, current);
+		spheresRead++;
+		return true;
+	}
+
+public:
+	static void Store(ReadSphere* scene, int i, const SphereValues& sphere)
+	{
+		const float (*v)[3] = sphere.values;
+		float radius = v[FIELD_START_RADIUS][0];
+		scene->spheres[i].center = Vec3f(v[FIELD_START_POS][0], v[FIELD_START_POS][1], v[FIELD_START_POS][2]);
+		scene->endPos[i] = Vec3f(v[FIELD_END_POS][0], v[FIELD_END_POS][1], v[FIELD_END_POS][2]);
+		scene->spheres[i].radius = radius;
+		scene->spheres[i].radius2 = radius * radius;
+		scene->endRad[i] = sphere.present & (1 << FIELD_END_RADIUS) ? v[FIELD_END_RADIUS][0] : radius;
+		scene->spheres[i].surfaceColor = Vec3f(v[FIELD_SURFACE_COLOUR][0], v[FIELD_SURFACE_COLOUR][1], v[FIELD_SURFACE_COLOUR][2]);
+		scene->endColours[i] = Vec3f(v[FIELD_END_COLOUR][0], v[FIELD_END_COLOUR][1], v[FIELD_END_COLOUR][2]);
+		scene->spheres[i].reflection = v[FIELD_REFLECTION][0];
+		scene->spheres[i].transparency = v[FIELD_TRANSPARENCY][0];
+		scene->spheres[i].emissionColor = Vec3f(v[FIELD_EMISSION_COLOUR][0], v[FIELD_EMISSION_COLOUR][1], v[FIELD_EMISSION_COLOUR][2]);
+	}
 
-		if (sphere.contains("surfaceColor"))
+private:
+	int depth = 0;
+	std::string topKey;
+	bool inSpheres = false;
+	SphereField field = FIELD_NONE;
+	int component = 0;
+	SphereValues current;
+	//TrackProperty of the track being read, -1 outside one
+	int track = -1;
+	//TrackProperty bits of the tracks the current sphere has given
+	int tracksRead = 0;
+	unsigned trackFirst = 0;
+	KeyField keyField = KEY_NONE;
+	int keyPresent = 0;
+	Keyframe currentKey;
+};
+
+//Everything that makes two spheres share a material, compared bit for bit
+struct MaterialKey
+{
+	Material material;
+	Vec3f colourChange;
+
+	bool operator==(const MaterialKey& other) const { return memcmp(this, &other, sizeof(MaterialKey)) == 0; }
+};
+
+struct MaterialKeyHash
+{
+	size_t operator()(const MaterialKey& key) const
+	{
+		//FNV-1a over the bytes
+		const unsigned char* bytes = (const unsigned char*)&key;
+		unsigned long long hash = 14695981039346656037ull;
+		for (size_t i = 0; i < sizeof(MaterialKey); i++)
+			hash = (hash ^ bytes[i]) * 1099511628211ull;
+		return (size_t)hash;
+	}
+};
+
+void ReadSphere::BuildMaterials()
+{
+	static_assert(sizeof(MaterialKey) == 11 * sizeof(float), "MaterialKey must have no padding to be compared bytewise");
+	std::unordered_map<MaterialKey, unsigned, MaterialKeyHash> found;
+	found.reserve(sphereAmount);
+	//a colour track changes the material itself, so it can't be shared
+	std::vector<char> keyedColour(sphereAmount, 0);
+	for (int t = 0; t < trackAmount; t++)
+	{
+		if (tracks[t].property == TRACK_COLOUR)
+			keyedColour[tracks[t].sphere] = 1;
+	}
+	materialAmount = 0;
+	for (int i = 0; i < sphereAmount; i++)
+	{
+		MaterialKey key;
+		key.material.surfaceColor = spheres[i].surfaceColor;
+		key.material.emissionColor = spheres[i].emissionColor;
+		key.material.transparency = spheres[i].transparency;
+		key.material.reflection = spheres[i].reflection;
+		key.colourChange = colourChange[i];
+		if (keyedColour[i])
 		{
-			std::vector<float> surfaceCol = sphere["surfaceColor"];
-			sphereInfo->spheres[i].surfaceColor = Vec3f(surfaceCol[0], surfaceCol[1], surfaceCol[2]);
+			materials[materialAmount] = key.material;
+			materialColourChange[materialAmount] = key.colourChange;
+			sphereMaterial[i] = materialAmount++;
+			continue;
 		}
-		else
-			failed = true;
-
-		if (sphere.contains("endColour"))
+		auto inserted = found.emplace(key, (unsigned)materialAmount);
+		if (inserted.second)
 		{
-			std::vector<float> endColour = sphere["endColour"];
-			sphereInfo->endColours[i] = Vec3f(endColour[0], endColour[1], endColour[2]);
+			materials[materialAmount] = key.material;
+			materialColourChange[materialAmount] = key.colourChange;
+			materialAmount++;
 		}
-		else
-			failed = true;
+		sphereMaterial[i] = inserted.first->second;
+	}
+}
+
+void ReadSphere::BuildAnimation()
+{
+	lights.clear();
+	for (int i = 0; i < sphereAmount; i++)
+	{
+		if (materials[sphereMaterial[i]].emissionColor.x > 0)
+			lights.push_back(i);
+	}
+	if (mapping != nullptr)
+		return;
+	for (int i = 0; i < sphereAmount; i++)
+	{
+		startX[i] = spheres[i].center.x;
+		startY[i] = spheres[i].center.y;
+		startZ[i] = spheres[i].center.z;
+		moveX[i] = movement[i].x;
+		moveY[i] = movement[i].y;
+		moveZ[i] = movement[i].z;
+		startRadius[i] = spheres[i].radius;
+	}
+}
+
+void ReadSphere::EvaluateFrame(int frame, FrameSpheres& out, ThreadPool* pool) const
+{
+	float step = (float)frame;
+	out.materials.resize(materialAmount);
+	for (int i = 0; i < materialAmount; i++)
+	{
+		out.materials[i] = materials[i];
+		out.materials[i].surfaceColor = materials[i].surfaceColor + materialColourChange[i] * step;
+	}
+	out.lights = lights;
+
+	out.Resize(sphereAmount);
+	int blocks = (sphereAmount + EVALUATE_BLOCK - 1) / EVALUATE_BLOCK;
+	if (pool != nullptr && blocks > 1)
+	{
+		pool->ParallelFor(blocks, [&](int block)
+			{
+				EvaluateSpheres(step, block * EVALUATE_BLOCK, std::min(sphereAmount, (block + 1) * EVALUATE_BLOCK), out);
+			});
+	}
+	else
+		EvaluateSpheres(step, 0, sphereAmount, out);
 
-		if (failed)
+	//keyframed properties replace what the linear animation gave them, a binary search each
+	for (int t = 0; t < trackAmount; t++)
+	{
+		const KeyTrack& track = tracks[t];
+		Vec3f value = Keyframes::Evaluate(keys + track.first, track.count, step);
+		unsigned i = track.sphere;
+		switch (track.property)
 		{
-			std::cout << "JSONReader: Values missing from file!" << std::endl;
-			return nullptr;
+		case TRACK_POSITION:
+			out.centerX[i] = value.x;
+			out.centerY[i] = value.y;
+			out.centerZ[i] = value.z;
+			break;
+		case TRACK_RADIUS:
+			out.radius2[i] = value.x * value.x;
+			break;
+		case TRACK_COLOUR:
+			out.materials[sphereMaterial[i]].surfaceColor = value;
+			break;
 		}
 	}
+}
+
+// Spheres first to last - 1 of the frame step frames in. Same operations in the same order as
+// Vec3f's, so the SIMD and scalar paths give identical spheres.
+void ReadSphere::EvaluateSpheres(float step, int first, int last, FrameSpheres& out) const
+{
+	int i = first;
+#if EVALUATE_SSE2
+	const __m128 frameStep = _mm_set1_ps(step);
+	for (; i + 4 <= last; i += 4)
+	{
+		_mm_storeu_ps(&out.centerX[i], _mm_add_ps(_mm_loadu_ps(&startX[i]), _mm_mul_ps(_mm_loadu_ps(&moveX[i]), frameStep)));
+		_mm_storeu_ps(&out.centerY[i], _mm_add_ps(_mm_loadu_ps(&startY[i]), _mm_mul_ps(_mm_loadu_ps(&moveY[i]), frameStep)));
+		_mm_storeu_ps(&out.centerZ[i], _mm_add_ps(_mm_loadu_ps(&startZ[i]), _mm_mul_ps(_mm_loadu_ps(&moveZ[i]), frameStep)));
+		__m128 radius = _mm_add_ps(_mm_loadu_ps(&startRadius[i]), _mm_mul_ps(_mm_loadu_ps(&radChange[i]), frameStep));
+		_mm_storeu_ps(&out.radius2[i], _mm_mul_ps(radius, radius));
+	}
+#endif
+	for (; i < last; i++)
+	{
+		out.centerX[i] = startX[i] + moveX[i] * step;
+		out.centerY[i] = startY[i] + moveY[i] * step;
+		out.centerZ[i] = startZ[i] + moveZ[i] * step;
+		float radius = startRadius[i] + radChange[i] * step;
+		out.radius2[i] = radius * radius;
+	}
+	memcpy(out.material.data() + first, sphereMaterial + first, (last - first) * sizeof(unsigned));
+}
+
+ReadSphere* JSONReader::LoadJSON(const char* path)
+{
+	//attribute everything the parser allocates, including the returned ReadSphere, to the JSON heap
+	HeapScope heapScope("JSON");
+
+	//attempt to read the file, if the file does not exist then output saying so and return null
+	FILE* file = fopen(path, "rb");
+	if (file == nullptr)
+	{
+		std::cout << "Unable to load file: " << path << std::endl;
+		return nullptr;
+	}
+	setvbuf(file, nullptr, _IOFBF, JSON_STREAM_BUFFER);
+	SceneSaxHandler handler;
+	bool parsed = json::sax_parse(file, &handler);
+	fclose(file);
+
+	//Check the file gave a sphere amount and the frame count, if it doesn't give either then null is returned and an output is given
+	ReadSphere* sphereInfo = handler.scene;
+	if (!parsed || handler.failed)
+	{
+		delete sphereInfo;
+		return nullptr;
+	}
+	if (handler.sphereCount < 0)
+	{
+		std::cout << "JSONReader could not find 'sphereAmount' in the JSON File." << std::endl;
+		delete sphereInfo;
+		return nullptr;
+	}
+	if (handler.frameCount < 0)
+	{
+		std::cout << "JSONReader could not find 'frameCount' in the JSON File." << std::endl;
+		delete sphereInfo;
+		return nullptr;
+	}
+	if (handler.spheresRead < handler.sphereCount)
+	{
+		std::cout << "JSONReader: Values missing from file!" << std::endl;
+		delete sphereInfo;
+		return nullptr;
+	}
+
+	//spheres that came before the count was known
+	if (sphereInfo == nullptr)
+	{
+		sphereInfo = new ReadSphere(handler.sphereCount, handler.frameCount);
+		for (int i = 0; i < handler.sphereCount; i++)
+			SceneSaxHandler::Store(sphereInfo, i, handler.pending[i]);
+	}
+	sphereInfo->frameCount = handler.frameCount;
+	sphereInfo->SetTracks(handler.tracks, handler.keys);
 
 	sphereInfo->CalcMovement();
 	sphereInfo->CalcColourChange();
 	sphereInfo->CalcRadiusChange();
+	sphereInfo->BuildMaterials();
+	sphereInfo->BuildAnimation();
 	return sphereInfo;
-}
\ No newline at end of file
+}
+
+bool JSONReader::SaveJSON(const ReadSphere* scene, const char* path)
+{
+	FILE* file = fopen(path, "wb");
+	if (file == nullptr)
+	{
+		std::cout << "Unable to create file: " << path << std::endl;
+		return false;
+	}
+	setvbuf(file, nullptr, _IOFBF, JSON_STREAM_BUFFER);
+
+	//%.9g gives back exactly the same float when the file is read again
+	fprintf(file, "{\n\t\"sphereAmount\": %d,\n\t\"frameCount\": %d,\n\t\"spheres\": [", scene->sphereAmount, scene->frameCount);
+	int track = 0;
+	for (int i = 0; i < scene->sphereAmount; i++)
+	{
+		const Sphere& sphere = scene->spheres[i];
+		const Vec3f& end = scene->endPos[i];
+		const Vec3f& endColour = scene->endColours[i];
+		fprintf(file, "%s\n\t\t{\n", i == 0 ? "" : ",");
+		fprintf(file, "\t\t\t\"startPos\": [ %.9g, %.9g, %.9g ],\n", sphere.center.x, sphere.center.y, sphere.center.z);
+		fprintf(file, "\t\t\t\"endPos\": [ %.9g, %.9g, %.9g ],\n", end.x, end.y, end.z);
+		fprintf(file, "\t\t\t\"startRadius\": %.9g,\n", sphere.radius);
+		fprintf(file, "\t\t\t\"endRadius\": %.9g,\n", scene->endRad[i]);
+		fprintf(file, "\t\t\t\"surfaceColor\": [ %.9g, %.9g, %.9g ],\n", sphere.surfaceColor.x, sphere.surfaceColor.y, sphere.surfaceColor.z);
+		fprintf(file, "\t\t\t\"endColour\": [ %.9g, %.9g, %.9g ],\n", endColour.x, endColour.y, endColour.z);
+		if (sphere.emissionColor.x != 0 || sphere.emissionColor.y != 0 || sphere.emissionColor.z != 0)
+			fprintf(file, "\t\t\t\"emissionColor\": [ %.9g, %.9g, %.9g ],\n", sphere.emissionColor.x, sphere.emissionColor.y, sphere.emissionColor.z);
+		//tracks are in sphere order, so this sphere's are the next ones
+		for (; track < scene->trackAmount && scene->tracks[track].sphere == (unsigned)i; track++)
+		{
+			const KeyTrack& keyTrack = scene->tracks[track];
+			fprintf(file, "\t\t\t\"%s\": [", Keyframes::TrackName(keyTrack.property));
+			for (unsigned k = 0; k < keyTrack.count; k++)
+			{
+				const Keyframe& key = scene->keys[keyTrack.first + k];
+				fprintf(file, "%s\n\t\t\t\t{ \"frame\": %.9g, \"value\": ", k == 0 ? "" : ",", key.frame);
+				if (keyTrack.property == TRACK_RADIUS)
+					fprintf(file, "%.9g", key.value.x);
+				else
+					fprintf(file, "[ %.9g, %.9g, %.9g ]", key.value.x, key.value.y, key.value.z);
+				fprintf(file, ", \"ease\": \"%s\" }", Keyframes::CurveName(key.curve));
+			}
+			fprintf(file, "\n\t\t\t],\n");
+		}
+		fprintf(file, "\t\t\t\"reflection\": %.9g,\n", sphere.reflection);
+		fprintf(file, "\t\t\t\"transparency\": %.9g\n\t\t}", sphere.transparency);
+	}
+	fprintf(file, "\n\t]\n}\n");
+
+	bool written = !ferror(file);
+	written = fclose(file) == 0 && written;
+	if (!written)
+		std::cout << "Failed writing file: " << path << std::endl;
+	return written;
+}
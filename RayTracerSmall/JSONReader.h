@@ -4,19 +4,52 @@
 #include "json.hpp"
 #include "Sphere.h"
 #include "Vec3.h"
+#include "FrameSpheres.h"
+#include "Keyframes.h"
+#include "MappedFile.h"
 #include <fstream>
+#include <algorithm>
+#include <vector>
 
 using nlohmann::json;
 
+class ThreadPool;
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define EVALUATE_SSE2 1
+#else
+#define EVALUATE_SSE2 0
+#endif
+
+//Smallest arena reserved for scene arrays, later scenes reuse it
+#define SCENE_ARENA_MIN (64 * 1024 * 1024)
+//stdio buffer scene files are streamed through while they are parsed or written
+#define JSON_STREAM_BUFFER (1024 * 1024)
+//Spheres a frame's evaluation is split into when it's shared across the pool, a multiple of 4
+#define EVALUATE_BLOCK (64 * 1024)
+
 class ReadSphere
 {
 public:
 	ReadSphere(int count, int frames);
+	//Arrays are pointed into file by the loader rather than allocated, and the file is closed with the scene
+	ReadSphere(int count, int frames, MappedFile* file);
 	~ReadSphere();
 
 	void CalcMovement();
 	void CalcColourChange();
 	void CalcRadiusChange();
+	//Copies parsed tracks and their keys into the scene, before BuildMaterials. Tracks have to be in sphere
+	//order, any for spheres past sphereAmount are dropped.
+	void SetTracks(const std::vector<KeyTrack>& sceneTracks, const std::vector<Keyframe>& sceneKeys);
+	//Gives each distinct look (colours, colour change, transparency, reflection) one material, after CalcColourChange
+	void BuildMaterials();
+	//Lays out what EvaluateFrame reads a field to an array and finds the lights, once the materials are built.
+	//A compiled scene has the arrays already, so only the lights are found.
+	void BuildAnimation();
+	//Writes the scene as it is on frame into out, worked out from the start state alone so frames can be
+	//evaluated in any order or on any thread. Given a pool, scenes over EVALUATE_BLOCK spheres are split across it.
+	void EvaluateFrame(int frame, FrameSpheres& out, ThreadPool* pool = nullptr) const;
 
 	Sphere* spheres;
 	int sphereAmount;
@@ -27,13 +60,53 @@ public:
 	Vec3f* colourChange;
 	float* endRad;
 	float* radChange;
+
+	//materials at the start of the animation, how each one's colour changes per frame, and which one each sphere uses
+	int materialAmount;
+	Material* materials;
+	Vec3f* materialColourChange;
+	unsigned* sphereMaterial;
+
+	//keyframe tracks, in sphere order, for properties that don't just go from start to end. A colour track
+	//animates the sphere's material, so BuildMaterials gives those spheres a material of their own.
+	int trackAmount;
+	KeyTrack* tracks;
+	int keyAmount;
+	Keyframe* keys;
+
+	//every sphere's start centre, movement and start radius an array a field, so four spheres evaluate at once
+	//straight out of a compiled scene's mapping. radChange is already one.
+	float* startX;
+	float* startY;
+	float* startZ;
+	float* moveX;
+	float* moveY;
+	float* moveZ;
+	float* startRadius;
 	
 	Sphere* sphere;
+
+private:
+	void EvaluateSpheres(float step, int first, int last, FrameSpheres& out) const;
+
+	//compiled scene the arrays live in, null when they were allocated
+	MappedFile* mapping;
+	//where allocated arrays come from, null for a compiled scene
+	Heap* sceneHeap;
+
+	//emission and materials don't animate, so neither do the lights
+	std::vector<unsigned> lights;
 };
 
 class JSONReader
 {
 public:
+	//Streams path through a SAX parser straight into the ReadSphere's arrays, memory stays bounded by the
+	//scene itself however large the file is. Besides startPos/endPos and the like, a sphere can give any of
+	//"positionKeys", "radiusKeys" and "colourKeys": arrays of { "frame": F, "value": V, "ease": CURVE } in
+	//increasing frame order, where CURVE is linear (the default), step, in, out, inout or spline.
 	static ReadSphere* LoadJSON(const char* path);
+	//Writes scene in the same format LoadJSON reads, one sphere at a time
+	static bool SaveJSON(const ReadSphere* scene, const char* path);
 };
 
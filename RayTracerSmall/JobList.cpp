@@ -0,0 +1,160 @@
+#include "JobList.h"
+#include "RayTracer.h"
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <unordered_map>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <direct.h>
+#define MakeDirectory(path) _mkdir(path)
+#else
+#include <sys/stat.h>
+#define MakeDirectory(path) mkdir(path, 0755)
+#endif
+
+JobList::~JobList()
+{
+	for (Job* job : m_jobs)
+		delete job;
+}
+
+//File name of path without its directory or extension, what a job's output directory is called
+static std::string SceneName(const char* path)
+{
+	std::string name = path;
+	size_t slash = name.find_last_of("/\\");
+	if (slash != std::string::npos)
+		name = name.substr(slash + 1);
+	size_t dot = name.find_last_of('.');
+	if (dot != std::string::npos && dot > 0)
+		name = name.substr(0, dot);
+	return name;
+}
+
+bool JobList::Load(const char* path, const RenderSettings& base)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		std::cout << "Unable to load file: " << path << std::endl;
+		return false;
+	}
+	m_root = base.outputDirectory;
+
+	//jobs whose scenes share a name get numbered directories rather than writing over each other
+	std::unordered_map<std::string, int> names;
+	std::string text;
+	int lineNumber = 0;
+	while (std::getline(file, text))
+	{
+		lineNumber++;
+		Job* job = new Job();
+		job->line = lineNumber;
+		std::istringstream words(text);
+		std::string word;
+		while (words >> word)
+			job->args.push_back(word);
+		if (job->args.empty() || job->args[0][0] == '#')
+		{
+			delete job;
+			continue;
+		}
+
+		//every line picks its own scene, and nothing on it can start another job list or stop to watch
+		job->settings = base;
+		job->settings.jobsPath = nullptr;
+		job->settings.generateSpec = nullptr;
+		std::string error;
+		for (size_t i = 0; i < job->args.size() && error.empty(); i++)
+		{
+			const char* arg = job->args[i].c_str();
+			if (i == 0 && strncmp(arg, "--", 2) != 0)
+				job->settings.scenePath = arg;
+			else if (!job->settings.ParseArg(arg))
+				error = std::string("unknown argument ") + arg;
+		}
+		const RenderSettings& settings = job->settings;
+		if (error.empty() && (settings.watch || settings.jobsPath != nullptr || settings.compilePath != nullptr ||
+			settings.exportPath != nullptr || settings.extractPath != nullptr))
+			error = "--watch, --jobs, --compile, --export and --extract can't be used in a job";
+		if (error.empty() && strncmp(job->args[0].c_str(), "--", 2) == 0 && settings.generateSpec == nullptr)
+			error = "no scene file or --generate";
+		if (!error.empty())
+		{
+			std::cout << path << " line " << lineNumber << ": " << error << std::endl;
+			delete job;
+			return false;
+		}
+
+		if (settings.outputDirectory == base.outputDirectory)
+		{
+			std::string name = settings.generateSpec != nullptr ? "generated" : SceneName(settings.scenePath);
+			int uses = ++names[name];
+			if (uses > 1)
+				name += "-" + std::to_string(uses);
+			job->outputDirectory = m_root + "/" + name;
+		}
+		else
+			job->outputDirectory = settings.outputDirectory;
+		job->settings.outputDirectory = job->outputDirectory.c_str();
+		m_jobs.push_back(job);
+	}
+	return true;
+}
+
+int JobList::Run(ThreadPool* pool)
+{
+	MakeDirectory(m_root.c_str());
+	//the Framebuffer arena is reserved by the first raytracer to ask for it, so it's reserved here first, big
+	//enough for whichever job needs most
+	size_t framebufferBytes = 0;
+	for (const Job* job : m_jobs)
+		framebufferBytes = std::max(framebufferBytes, Raytracer::FramebufferArenaBytes(job->settings, pool->GetSize()));
+	if (framebufferBytes > 0)
+		HeapDirector::CreateMappedHeap("Framebuffer", framebufferBytes);
+
+	int failed = 0;
+	RunningJob previous = {};
+	for (const Job* job : m_jobs)
+	{
+		RunningJob current = { nullptr, job, std::chrono::high_resolution_clock::now() };
+		//parsed on this thread while the workers are still busy with the previous job's frames
+		const RenderSettings& settings = job->settings;
+		ReadSphere* scene = settings.generateSpec != nullptr ? SceneGenerator::Generate(settings.generateSpec) : SceneFile::LoadScene(settings.scenePath);
+		if (scene == nullptr)
+		{
+			std::cout << "Skipping the job on line " << job->line << std::endl;
+			failed++;
+		}
+		else
+		{
+			MakeDirectory(job->outputDirectory.c_str());
+			current.raytracer = new Raytracer(pool, settings);
+			current.raytracer->SetJSON(scene);
+			current.raytracer->QueueFrames();
+		}
+
+		//this job's frames are queued behind the previous job's, so only now is that one waited for
+		if (previous.raytracer != nullptr)
+			Finish(previous);
+		previous = current;
+	}
+	if (previous.raytracer != nullptr)
+		Finish(previous);
+	return failed;
+}
+
+void JobList::Finish(RunningJob& running)
+{
+	running.raytracer->FinishFrames();
+	delete running.raytracer;
+	running.raytracer = nullptr;
+
+	auto stop = std::chrono::high_resolution_clock::now();
+	std::stringstream msg;
+	msg << "Job on line " << running.job->line << " finished into " << running.job->outputDirectory << " in "
+		<< std::chrono::duration_cast<std::chrono::milliseconds>(stop - running.start).count() << "ms\n";
+	std::cout << msg.str();
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "RenderSettings.h"
+#include <string>
+#include <vector>
+#include <chrono>
+
+class ThreadPool;
+class Raytracer;
+
+//One line of a job list: the scene and the settings it's rendered with. The settings point into args and
+//outputDirectory, so a job stays where it was made until the list is done with.
+struct Job
+{
+	int line;
+	std::vector<std::string> args;
+	std::string outputDirectory;
+	RenderSettings settings;
+};
+
+//Renders many scenes in one process, sharing the pool, heaps and everything else set up once at startup
+class JobList
+{
+public:
+	~JobList();
+
+	//Reads path, a job a line: a scene file followed by any --name=value settings for it alone, on top of base.
+	//A line can leave the scene out and --generate one instead. Blank lines and lines starting with # are
+	//skipped. False if the file can't be read or any line doesn't parse.
+	bool Load(const char* path, const RenderSettings& base);
+	//Renders every job through pool. Each job's scene is loaded and its frames queued while the job before is
+	//still rendering, so the workers go straight from one job's last frames to the next's first. Returns how
+	//many jobs failed to load.
+	int Run(ThreadPool* pool);
+
+	size_t GetCount() { return m_jobs.size(); }
+
+private:
+	//Started job and when, so it can be reported once FinishFrames returns
+	struct RunningJob
+	{
+		Raytracer* raytracer;
+		const Job* job;
+		std::chrono::high_resolution_clock::time_point start;
+	};
+	void Finish(RunningJob& running);
+
+	std::vector<Job*> m_jobs;
+	std::string m_root;
+};
@@ -0,0 +1,421 @@
+#include "JpegEncoder.h"
+#include <cmath>
+#include <cstring>
+
+//Maps a natural (row major) coefficient index to its position in zigzag order
+static const unsigned char zigzag[64] = {
+	0, 1, 5, 6, 14, 15, 27, 28, 2, 4, 7, 13, 16, 26, 29, 42,
+	3, 8, 12, 17, 25, 30, 41, 43, 9, 11, 18, 24, 31, 40, 44, 53,
+	10, 19, 23, 32, 39, 45, 52, 54, 20, 22, 33, 38, 46, 51, 55, 60,
+	21, 34, 37, 47, 50, 56, 59, 61, 35, 36, 48, 49, 57, 58, 62, 63 };
+
+//Standard luminance and chrominance quantization tables (JPEG Annex K), natural order
+static const unsigned char baseQTY[64] = {
+	16, 11, 10, 16, 24, 40, 51, 61, 12, 12, 14, 19, 26, 58, 60, 55,
+	14, 13, 16, 24, 40, 57, 69, 56, 14, 17, 22, 29, 51, 87, 80, 62,
+	18, 22, 37, 56, 68, 109, 103, 77, 24, 35, 55, 64, 81, 104, 113, 92,
+	49, 64, 78, 87, 103, 121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99 };
+static const unsigned char baseQTUV[64] = {
+	17, 18, 24, 47, 99, 99, 99, 99, 18, 21, 26, 66, 99, 99, 99, 99,
+	24, 26, 56, 99, 99, 99, 99, 99, 47, 66, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+	99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99 };
+
+//Standard Huffman tables (JPEG Annex K), code counts for lengths 1-16 followed by the symbols
+static const unsigned char dcYCounts[16] = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+static const unsigned char dcYValues[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+static const unsigned char dcUVCounts[16] = { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+static const unsigned char dcUVValues[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+static const unsigned char acYCounts[16] = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+static const unsigned char acYValues[162] = {
+	0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+	0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+	0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+	0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+	0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+	0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+	0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+	0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+	0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+	0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+	0xf9, 0xfa };
+static const unsigned char acUVCounts[16] = { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+static const unsigned char acUVValues[162] = {
+	0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+	0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+	0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+	0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+	0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+	0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+	0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+	0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+	0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+	0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+	0xf9, 0xfa };
+
+//AAN scale factors, folded into the quantization divisors so the DCT itself needs no multiplies for them
+static const float aanScale[8] = {
+	1.0f * 2.828427125f, 1.387039845f * 2.828427125f, 1.306562965f * 2.828427125f, 1.175875602f * 2.828427125f,
+	1.0f * 2.828427125f, 0.785694958f * 2.828427125f, 0.541196100f * 2.828427125f, 0.275899379f * 2.828427125f };
+
+//Collects Huffman codes into bytes, stuffing a zero after every 0xFF
+struct BitWriter
+{
+	std::vector<unsigned char>* out;
+	unsigned int buffer = 0;
+	int count = 0;
+
+	void Write(unsigned int code, int length)
+	{
+		buffer = (buffer << length) | code;
+		count += length;
+		while (count >= 8)
+		{
+			unsigned char c = (unsigned char)(buffer >> (count - 8));
+			out->push_back(c);
+			if (c == 0xFF)
+				out->push_back(0);
+			count -= 8;
+		}
+		buffer &= (1u << count) - 1;
+	}
+
+	//Pads the last byte with one bits, as required before a marker
+	void Flush()
+	{
+		if (count > 0)
+			Write((1u << (8 - count)) - 1, 8 - count);
+	}
+};
+
+static void BuildHuffTable(const unsigned char* counts, const unsigned char* values, unsigned short* codes, unsigned short* lengths)
+{
+	//canonical Huffman codes: consecutive values within a length, doubling between lengths
+	int k = 0;
+	unsigned short code = 0;
+	for (int length = 1; length <= 16; length++)
+	{
+		for (int i = 0; i < counts[length - 1]; i++, k++)
+		{
+			codes[values[k]] = code++;
+			lengths[values[k]] = (unsigned short)length;
+		}
+		code <<= 1;
+	}
+}
+
+JpegEncoder::JpegEncoder(int quality)
+{
+	if (quality < 1)
+		quality = 1;
+	if (quality > 100)
+		quality = 100;
+	int scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+
+	for (int i = 0; i < 64; i++)
+	{
+		int y = (baseQTY[i] * scale + 50) / 100;
+		int uv = (baseQTUV[i] * scale + 50) / 100;
+		qtY[zigzag[i]] = (unsigned char)(y < 1 ? 1 : (y > 255 ? 255 : y));
+		qtUV[zigzag[i]] = (unsigned char)(uv < 1 ? 1 : (uv > 255 ? 255 : uv));
+	}
+	for (int row = 0, k = 0; row < 8; row++)
+	{
+		for (int col = 0; col < 8; col++, k++)
+		{
+			fdtblY[k] = 1.0f / (qtY[zigzag[k]] * aanScale[row] * aanScale[col]);
+			fdtblUV[k] = 1.0f / (qtUV[zigzag[k]] * aanScale[row] * aanScale[col]);
+		}
+	}
+
+	unsigned short codes[256];
+	unsigned short lengths[256];
+	BuildHuffTable(dcYCounts, dcYValues, codes, lengths);
+	for (int i = 0; i < 12; i++)
+		dcY[i] = { codes[i], lengths[i] };
+	BuildHuffTable(dcUVCounts, dcUVValues, codes, lengths);
+	for (int i = 0; i < 12; i++)
+		dcUV[i] = { codes[i], lengths[i] };
+	memset(lengths, 0, sizeof(lengths));
+	BuildHuffTable(acYCounts, acYValues, codes, lengths);
+	for (int i = 0; i < 256; i++)
+		acY[i] = { codes[i], lengths[i] };
+	memset(lengths, 0, sizeof(lengths));
+	BuildHuffTable(acUVCounts, acUVValues, codes, lengths);
+	for (int i = 0; i < 256; i++)
+		acUV[i] = { codes[i], lengths[i] };
+}
+
+//1-D AAN forward DCT down all eight columns of a block at once. The loop body only ever touches
+//lane i of each row, so the compiler turns it into packed SIMD arithmetic.
+static void DCTColumns(float* block)
+{
+	float* r0 = block;
+	float* r1 = block + 8;
+	float* r2 = block + 16;
+	float* r3 = block + 24;
+	float* r4 = block + 32;
+	float* r5 = block + 40;
+	float* r6 = block + 48;
+	float* r7 = block + 56;
+	for (int i = 0; i < 8; i++)
+	{
+		float tmp0 = r0[i] + r7[i];
+		float tmp7 = r0[i] - r7[i];
+		float tmp1 = r1[i] + r6[i];
+		float tmp6 = r1[i] - r6[i];
+		float tmp2 = r2[i] + r5[i];
+		float tmp5 = r2[i] - r5[i];
+		float tmp3 = r3[i] + r4[i];
+		float tmp4 = r3[i] - r4[i];
+
+		//even part
+		float tmp10 = tmp0 + tmp3;
+		float tmp13 = tmp0 - tmp3;
+		float tmp11 = tmp1 + tmp2;
+		float tmp12 = tmp1 - tmp2;
+		r0[i] = tmp10 + tmp11;
+		r4[i] = tmp10 - tmp11;
+		float z1 = (tmp12 + tmp13) * 0.707106781f;
+		r2[i] = tmp13 + z1;
+		r6[i] = tmp13 - z1;
+
+		//odd part
+		tmp10 = tmp4 + tmp5;
+		tmp11 = tmp5 + tmp6;
+		tmp12 = tmp6 + tmp7;
+		float z5 = (tmp10 - tmp12) * 0.382683433f;
+		float z2 = tmp10 * 0.541196100f + z5;
+		float z4 = tmp12 * 1.306562965f + z5;
+		float z3 = tmp11 * 0.707106781f;
+		float z11 = tmp7 + z3;
+		float z13 = tmp7 - z3;
+		r5[i] = z13 + z2;
+		r3[i] = z13 - z2;
+		r1[i] = z11 + z4;
+		r7[i] = z11 - z4;
+	}
+}
+
+static void Transpose(float* block)
+{
+	for (int row = 0; row < 8; row++)
+	{
+		for (int col = row + 1; col < 8; col++)
+		{
+			float t = block[row * 8 + col];
+			block[row * 8 + col] = block[col * 8 + row];
+			block[col * 8 + row] = t;
+		}
+	}
+}
+
+//Transforms, quantizes and Huffman codes one 8x8 block, returns its DC value for the next block's prediction
+static int EncodeBlock(BitWriter& bits, float* block, const float* fdtbl, int prevDC, const JpegHuffCode* dc, const JpegHuffCode* ac)
+{
+	//2-D DCT as columns, then rows by way of a transpose
+	DCTColumns(block);
+	Transpose(block);
+	DCTColumns(block);
+	Transpose(block);
+
+	int coefficients[64];
+	for (int i = 0; i < 64; i++)
+	{
+		float v = block[i] * fdtbl[i];
+		coefficients[zigzag[i]] = (int)(v < 0 ? ceilf(v - 0.5f) : floorf(v + 0.5f));
+	}
+
+	//values are sent as a category (bit count) followed by that many bits, negatives one's complemented
+	int diff = coefficients[0] - prevDC;
+	int magnitude = diff < 0 ? -diff : diff;
+	int category = 0;
+	while (magnitude >> category)
+		category++;
+	bits.Write(dc[category].code, dc[category].length);
+	if (category > 0)
+		bits.Write((diff < 0 ? diff - 1 : diff) & ((1 << category) - 1), category);
+
+	int last = 63;
+	while (last > 0 && coefficients[last] == 0)
+		last--;
+	for (int i = 1; i <= last; i++)
+	{
+		int run = 0;
+		while (coefficients[i] == 0)
+		{
+			i++;
+			run++;
+		}
+		//runs of 16 zeros get their own symbol
+		while (run >= 16)
+		{
+			bits.Write(ac[0xF0].code, ac[0xF0].length);
+			run -= 16;
+		}
+		int value = coefficients[i];
+		magnitude = value < 0 ? -value : value;
+		category = 0;
+		while (magnitude >> category)
+			category++;
+		int symbol = (run << 4) | category;
+		bits.Write(ac[symbol].code, ac[symbol].length);
+		bits.Write((value < 0 ? value - 1 : value) & ((1 << category) - 1), category);
+	}
+	if (last != 63)
+		bits.Write(ac[0x00].code, ac[0x00].length);
+	return coefficients[0];
+}
+
+static void WriteMarker(std::vector<unsigned char>& out, unsigned char marker, unsigned short length)
+{
+	out.push_back(0xFF);
+	out.push_back(marker);
+	out.push_back((unsigned char)(length >> 8));
+	out.push_back((unsigned char)length);
+}
+
+void JpegEncoder::WriteHeaders(std::vector<unsigned char>& out, unsigned width, unsigned height, unsigned mcusPerRow)
+{
+	//SOI and a minimal JFIF APP0
+	static const unsigned char jfif[] = { 0xFF, 0xD8, 0xFF, 0xE0, 0, 16, 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0 };
+	out.insert(out.end(), jfif, jfif + sizeof(jfif));
+
+	//both quantization tables
+	WriteMarker(out, 0xDB, 2 + 2 * 65);
+	out.push_back(0);
+	out.insert(out.end(), qtY, qtY + 64);
+	out.push_back(1);
+	out.insert(out.end(), qtUV, qtUV + 64);
+
+	//baseline frame, Y sampled 2x2 against one Cb and one Cr per MCU
+	WriteMarker(out, 0xC0, 17);
+	out.push_back(8);
+	out.push_back((unsigned char)(height >> 8));
+	out.push_back((unsigned char)height);
+	out.push_back((unsigned char)(width >> 8));
+	out.push_back((unsigned char)width);
+	static const unsigned char components[] = { 3, 1, 0x22, 0, 2, 0x11, 1, 3, 0x11, 1 };
+	out.insert(out.end(), components, components + sizeof(components));
+
+	//the four standard Huffman tables
+	struct Table { unsigned char id; const unsigned char* counts; const unsigned char* values; int valueCount; };
+	const Table tables[] = {
+		{ 0x00, dcYCounts, dcYValues, 12 }, { 0x10, acYCounts, acYValues, 162 },
+		{ 0x01, dcUVCounts, dcUVValues, 12 }, { 0x11, acUVCounts, acUVValues, 162 } };
+	WriteMarker(out, 0xC4, 2 + 4 * 17 + 2 * 12 + 2 * 162);
+	for (int t = 0; t < 4; t++)
+	{
+		out.push_back(tables[t].id);
+		out.insert(out.end(), tables[t].counts, tables[t].counts + 16);
+		out.insert(out.end(), tables[t].values, tables[t].values + tables[t].valueCount);
+	}
+
+	//one restart interval per MCU row, which is what lets rows be coded independently
+	WriteMarker(out, 0xDD, 4);
+	out.push_back((unsigned char)(mcusPerRow >> 8));
+	out.push_back((unsigned char)mcusPerRow);
+
+	static const unsigned char scan[] = { 0xFF, 0xDA, 0, 12, 3, 1, 0x00, 2, 0x11, 3, 0x11, 0, 63, 0 };
+	out.insert(out.end(), scan, scan + sizeof(scan));
+}
+
+void JpegEncoder::EncodeMCURow(const unsigned char* rgb, unsigned width, unsigned height, unsigned mcuRow, std::vector<unsigned char>& out)
+{
+	BitWriter bits;
+	bits.out = &out;
+	//DC prediction restarts at every restart interval
+	int dcYPrev = 0;
+	int dcCbPrev = 0;
+	int dcCrPrev = 0;
+
+	float yPlane[256];
+	float cbPlane[256];
+	float crPlane[256];
+	float block[64];
+
+	unsigned mcusPerRow = (width + 15) / 16;
+	for (unsigned mcu = 0; mcu < mcusPerRow; mcu++)
+	{
+		//convert the 16x16 MCU to YCbCr, clamping reads at the image edge
+		for (unsigned py = 0; py < 16; py++)
+		{
+			unsigned y = mcuRow * 16 + py;
+			if (y >= height)
+				y = height - 1;
+			for (unsigned px = 0; px < 16; px++)
+			{
+				unsigned x = mcu * 16 + px;
+				if (x >= width)
+					x = width - 1;
+				const unsigned char* p = rgb + ((size_t)y * width + x) * 3;
+				float r = p[0];
+				float g = p[1];
+				float b = p[2];
+				yPlane[py * 16 + px] = 0.299f * r + 0.587f * g + 0.114f * b - 128.0f;
+				cbPlane[py * 16 + px] = -0.16874f * r - 0.33126f * g + 0.5f * b;
+				crPlane[py * 16 + px] = 0.5f * r - 0.41869f * g - 0.08131f * b;
+			}
+		}
+
+		for (int by = 0; by < 2; by++)
+		{
+			for (int bx = 0; bx < 2; bx++)
+			{
+				for (int i = 0; i < 64; i++)
+					block[i] = yPlane[(by * 8 + i / 8) * 16 + bx * 8 + i % 8];
+				dcYPrev = EncodeBlock(bits, block, fdtblY, dcYPrev, dcY, acY);
+			}
+		}
+
+		//chroma is averaged over each 2x2 group of pixels
+		for (int i = 0; i < 64; i++)
+		{
+			int p = (i / 8) * 32 + (i % 8) * 2;
+			block[i] = (cbPlane[p] + cbPlane[p + 1] + cbPlane[p + 16] + cbPlane[p + 17]) * 0.25f;
+		}
+		dcCbPrev = EncodeBlock(bits, block, fdtblUV, dcCbPrev, dcUV, acUV);
+		for (int i = 0; i < 64; i++)
+		{
+			int p = (i / 8) * 32 + (i % 8) * 2;
+			block[i] = (crPlane[p] + crPlane[p + 1] + crPlane[p + 16] + crPlane[p + 17]) * 0.25f;
+		}
+		dcCrPrev = EncodeBlock(bits, block, fdtblUV, dcCrPrev, dcUV, acUV);
+	}
+	bits.Flush();
+}
+
+void JpegEncoder::Encode(const unsigned char* rgb, unsigned width, unsigned height, std::vector<unsigned char>& out, ThreadPool* pool)
+{
+	unsigned mcusPerRow = (width + 15) / 16;
+	unsigned mcuRows = (height + 15) / 16;
+
+	//each MCU row is entropy coded into its own buffer, then they're stitched together with restart markers
+	std::vector<std::vector<unsigned char>> rows(mcuRows);
+	auto encodeRow = [&](int row)
+	{
+		rows[row].reserve((size_t)mcusPerRow * 256);
+		EncodeMCURow(rgb, width, height, row, rows[row]);
+	};
+	if (pool != nullptr)
+		pool->ParallelFor((int)mcuRows, encodeRow);
+	else
+	{
+		for (unsigned row = 0; row < mcuRows; row++)
+			encodeRow(row);
+	}
+
+	out.clear();
+	WriteHeaders(out, width, height, mcusPerRow);
+	for (unsigned row = 0; row < mcuRows; row++)
+	{
+		out.insert(out.end(), rows[row].begin(), rows[row].end());
+		if (row + 1 < mcuRows)
+		{
+			out.push_back(0xFF);
+			out.push_back((unsigned char)(0xD0 + row % 8));
+		}
+	}
+	out.push_back(0xFF);
+	out.push_back(0xD9);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+#include "ThreadPool.h"
+
+//Quality used when none is given, 1-100 on the usual IJG scale
+#define JPEG_DEFAULT_QUALITY 90
+
+//One Huffman code, right aligned in code
+struct JpegHuffCode
+{
+	unsigned short code;
+	unsigned short length;
+};
+
+//Baseline JPEG encoder (YCbCr 4:2:0, standard Huffman tables). Every row of 16x16 MCUs is its own
+//restart interval, so rows are entropy coded independently and can be spread across the ThreadPool.
+class JpegEncoder
+{
+public:
+	JpegEncoder(int quality = JPEG_DEFAULT_QUALITY);
+
+	//Encodes a width x height rgb24 image into out, which is cleared first. With a pool the MCU rows are
+	//encoded in parallel, otherwise on the calling thread. Safe to call from several threads at once.
+	void Encode(const unsigned char* rgb, unsigned width, unsigned height, std::vector<unsigned char>& out, ThreadPool* pool);
+
+private:
+	void WriteHeaders(std::vector<unsigned char>& out, unsigned width, unsigned height, unsigned mcusPerRow);
+	void EncodeMCURow(const unsigned char* rgb, unsigned width, unsigned height, unsigned mcuRow, std::vector<unsigned char>& out);
+
+	//quantization tables in zigzag order as written to the file, and the matching DCT divisors in natural order
+	unsigned char qtY[64];
+	unsigned char qtUV[64];
+	float fdtblY[64];
+	float fdtblUV[64];
+
+	JpegHuffCode dcY[12];
+	JpegHuffCode dcUV[12];
+	JpegHuffCode acY[256];
+	JpegHuffCode acUV[256];
+};
@@ -0,0 +1,75 @@
+#include "Keyframes.h"
+#include <algorithm>
+#include <cstring>
+
+static const char* s_curveNames[CURVE_COUNT] = { "linear", "step", "in", "out", "inout", "spline" };
+static const char* s_trackNames[TRACK_PROPERTY_COUNT] = { "positionKeys", "radiusKeys", "colourKeys" };
+
+Vec3f Keyframes::Evaluate(const Keyframe* keys, unsigned count, float frame)
+{
+	//first key after frame, the segment being evaluated ends there
+	const Keyframe* next = std::upper_bound(keys, keys + count, frame,
+		[](float time, const Keyframe& key) { return time < key.frame; });
+	if (next == keys)
+		return keys[0].value;
+	if (next == keys + count)
+		return keys[count - 1].value;
+
+	const Keyframe& from = next[-1];
+	const Keyframe& to = next[0];
+	float span = to.frame - from.frame;
+	float t = (frame - from.frame) / span;
+	switch (from.curve)
+	{
+	case CURVE_STEP:
+		return from.value;
+	case CURVE_EASE_IN:
+		t = t * t;
+		break;
+	case CURVE_EASE_OUT:
+		t = t * (2 - t);
+		break;
+	case CURVE_EASE_IN_OUT:
+		t = t * t * (3 - 2 * t);
+		break;
+	case CURVE_SPLINE:
+	{
+		//Catmull-Rom as a Hermite curve, the tangents scaled by how far apart the keys are so unevenly spaced
+		//keys don't overshoot. The first and last keys use their own segment for the missing neighbour.
+		const Keyframe& before = next - 1 == keys ? from : next[-2];
+		const Keyframe& after = next + 1 == keys + count ? to : next[1];
+		Vec3f startTangent = (to.value - before.value) * (span / (to.frame - before.frame));
+		Vec3f endTangent = (after.value - from.value) * (span / (after.frame - from.frame));
+		float t2 = t * t;
+		float t3 = t2 * t;
+		return from.value * (2 * t3 - 3 * t2 + 1) + startTangent * (t3 - 2 * t2 + t) +
+			to.value * (3 * t2 - 2 * t3) + endTangent * (t3 - t2);
+	}
+	default:
+		break;
+	}
+	return from.value + (to.value - from.value) * t;
+}
+
+bool Keyframes::ParseCurve(const char* name, KeyCurve& curve)
+{
+	for (int i = 0; i < CURVE_COUNT; i++)
+	{
+		if (strcmp(name, s_curveNames[i]) == 0)
+		{
+			curve = (KeyCurve)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+const char* Keyframes::CurveName(unsigned curve)
+{
+	return curve < CURVE_COUNT ? s_curveNames[curve] : s_curveNames[CURVE_LINEAR];
+}
+
+const char* Keyframes::TrackName(unsigned property)
+{
+	return s_trackNames[property];
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Vec3.h"
+
+//What a keyframe track animates, radius tracks only use value.x
+enum TrackProperty
+{
+	TRACK_POSITION,
+	TRACK_RADIUS,
+	TRACK_COLOUR,
+	TRACK_PROPERTY_COUNT
+};
+
+//How a track gets from one keyframe to the next, set on the earlier of the two
+enum KeyCurve
+{
+	CURVE_LINEAR,
+	CURVE_STEP,			//holds the value until the next key
+	CURVE_EASE_IN,		//starts slow
+	CURVE_EASE_OUT,		//ends slow
+	CURVE_EASE_IN_OUT,	//starts and ends slow
+	CURVE_SPLINE,		//Catmull-Rom through the keys either side, so the motion has no corners
+	CURVE_COUNT
+};
+
+struct Keyframe
+{
+	float frame;
+	Vec3f value;
+	unsigned curve;
+};
+
+//The keys of one property of one sphere, keys[first] to keys[first + count - 1] in increasing frame order
+struct KeyTrack
+{
+	unsigned sphere;
+	unsigned property;
+	unsigned first;
+	unsigned count;
+};
+
+//Multi-keyframe animation for the properties that would otherwise go linearly from start to end
+class Keyframes
+{
+public:
+	//Value of a track on frame, found by binary search so it's O(log count). Before the first key and
+	//after the last the track holds still.
+	static Vec3f Evaluate(const Keyframe* keys, unsigned count, float frame);
+
+	//Names used for curves in scene files, false for a name that isn't one
+	static bool ParseCurve(const char* name, KeyCurve& curve);
+	static const char* CurveName(unsigned curve);
+	//Names of the track fields on a sphere in scene files, indexed by TrackProperty
+	static const char* TrackName(unsigned property);
+};
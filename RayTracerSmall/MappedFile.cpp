@@ -0,0 +1,115 @@
+#include "MappedFile.h"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+MappedFile::MappedFile()
+{
+
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::Open(const char* path, size_t size)
+{
+	Close();
+#ifdef _WIN32
+	m_file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (m_file == INVALID_HANDLE_VALUE)
+	{
+		m_file = nullptr;
+		return false;
+	}
+	//the mapping sets the file length, so no separate truncate is needed
+	m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READWRITE, (DWORD)((unsigned long long)size >> 32), (DWORD)size, NULL);
+	if (m_mapping != NULL)
+		m_data = (char*)MapViewOfFile(m_mapping, FILE_MAP_WRITE, 0, 0, size);
+#else
+	m_fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (m_fd < 0)
+		return false;
+	if (ftruncate(m_fd, (off_t)size) == 0)
+	{
+		void* pMem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+		if (pMem != MAP_FAILED)
+			m_data = (char*)pMem;
+	}
+#endif
+	if (m_data == nullptr)
+	{
+		Close();
+		return false;
+	}
+	m_size = size;
+	return true;
+}
+
+bool MappedFile::OpenRead(const char* path)
+{
+	Close();
+	size_t size = 0;
+#ifdef _WIN32
+	m_file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (m_file == INVALID_HANDLE_VALUE)
+	{
+		m_file = nullptr;
+		return false;
+	}
+	LARGE_INTEGER length;
+	if (GetFileSizeEx(m_file, &length) && length.QuadPart > 0)
+	{
+		size = (size_t)length.QuadPart;
+		m_mapping = CreateFileMappingA(m_file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+		if (m_mapping != NULL)
+			m_data = (char*)MapViewOfFile(m_mapping, FILE_MAP_COPY, 0, 0, size);
+	}
+#else
+	m_fd = open(path, O_RDONLY);
+	if (m_fd < 0)
+		return false;
+	off_t length = lseek(m_fd, 0, SEEK_END);
+	if (length > 0)
+	{
+		size = (size_t)length;
+		void* pMem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, m_fd, 0);
+		if (pMem != MAP_FAILED)
+			m_data = (char*)pMem;
+	}
+#endif
+	if (m_data == nullptr)
+	{
+		Close();
+		return false;
+	}
+	m_size = size;
+	return true;
+}
+
+void MappedFile::Close()
+{
+#ifdef _WIN32
+	if (m_data != nullptr)
+		UnmapViewOfFile(m_data);
+	if (m_mapping != nullptr)
+		CloseHandle(m_mapping);
+	if (m_file != nullptr)
+		CloseHandle(m_file);
+	m_mapping = nullptr;
+	m_file = nullptr;
+#else
+	if (m_data != nullptr)
+		munmap(m_data, m_size);
+	if (m_fd >= 0)
+		close(m_fd);
+	m_fd = -1;
+#endif
+	m_data = nullptr;
+	m_size = 0;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+
+//An output file sized up front and mapped into memory so frames can be written straight into it
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	//Creates or truncates path to exactly size bytes and maps it writable
+	bool Open(const char* path, size_t size);
+	//Maps an existing file copy on write: it reads like the file, and anything written stays in this process
+	bool OpenRead(const char* path);
+	//Unmaps and closes, the kernel writes the dirty pages back in its own time
+	void Close();
+
+	char* GetData() { return m_data; }
+	size_t GetSize() { return m_size; }
+
+private:
+	char* m_data = nullptr;
+	size_t m_size = 0;
+#ifdef _WIN32
+	void* m_file = nullptr;
+	void* m_mapping = nullptr;
+#else
+	int m_fd = -1;
+#endif
+};
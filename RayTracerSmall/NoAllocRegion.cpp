@@ -0,0 +1,47 @@
+#include "NoAllocRegion.h"
+#include <cstdio>
+#include <cstdlib>
+#ifndef _WIN32
+#include <execinfo.h>
+#include <unistd.h>
+#endif
+
+//How many frames of backtrace to print for a stray allocation
+#define NO_ALLOC_BACKTRACE_DEPTH 32
+
+thread_local NoAllocRegion* NoAllocRegion::s_current = nullptr;
+
+NoAllocRegion::NoAllocRegion(const char* name, NoAllocAction action)
+{
+	m_name = name;
+	m_action = action;
+	m_previous = s_current;
+	s_current = this;
+}
+
+NoAllocRegion::~NoAllocRegion()
+{
+	s_current = m_previous;
+}
+
+void NoAllocRegion::OnAllocation(size_t size)
+{
+	NoAllocRegion* region = s_current;
+	region->m_allocations++;
+	region->m_allocatedBytes += size;
+	if (region->m_action == NoAllocAction::Count)
+		return;
+
+	//step out of the region while reporting, printing the backtrace may allocate itself
+	s_current = nullptr;
+	//stdio rather than iostream so reporting doesn't need a stringstream
+	fprintf(stderr, "NoAllocRegion '%s': allocation of %zu bytes\n", region->m_name, size);
+#ifndef _WIN32
+	void* frames[NO_ALLOC_BACKTRACE_DEPTH];
+	int frameCount = backtrace(frames, NO_ALLOC_BACKTRACE_DEPTH);
+	backtrace_symbols_fd(frames, frameCount, STDERR_FILENO);
+#endif
+	if (region->m_action == NoAllocAction::Abort)
+		abort();
+	s_current = region;
+}
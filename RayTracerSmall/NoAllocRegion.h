@@ -0,0 +1,48 @@
+#pragma once
+
+//Included through Global.h, which decides MEMORY_DEBUG
+
+#include <cstddef>
+
+//What happens when something allocates inside a NoAllocRegion
+enum class NoAllocAction
+{
+	Count,	//only count it, read back with GetAllocationCount
+	Report,	//count it and print the size and a backtrace to stderr
+	Abort	//report it then abort
+};
+
+//Debug builds report stray allocations as they happen, release builds just count them
+#if MEMORY_DEBUG
+#define NO_ALLOC_DEFAULT_ACTION NoAllocAction::Report
+#else
+#define NO_ALLOC_DEFAULT_ACTION NoAllocAction::Count
+#endif
+
+//Marks a stretch of code on the current thread that must not allocate. Every operator new on
+//the thread while the region is alive is handed to the innermost region.
+class NoAllocRegion
+{
+public:
+	NoAllocRegion(const char* name, NoAllocAction action = NO_ALLOC_DEFAULT_ACTION);
+	~NoAllocRegion();
+
+	NoAllocRegion(const NoAllocRegion&) = delete;
+	NoAllocRegion& operator=(const NoAllocRegion&) = delete;
+
+	size_t GetAllocationCount() { return m_allocations; }
+	size_t GetAllocatedBytes() { return m_allocatedBytes; }
+
+	static bool IsActive() { return s_current != nullptr; }
+	//called by operator new whenever IsActive is true
+	static void OnAllocation(size_t size);
+
+private:
+	const char* m_name;
+	NoAllocAction m_action;
+	size_t m_allocations = 0;
+	size_t m_allocatedBytes = 0;
+	NoAllocRegion* m_previous;
+
+	static thread_local NoAllocRegion* s_current;
+};
@@ -0,0 +1,71 @@
+#include "OrderedFrameSink.h"
+
+OrderedFrameSink::OrderedFrameSink(FrameWriter* writer)
+{
+	m_writer = writer;
+}
+
+OrderedFrameSink::~OrderedFrameSink()
+{
+
+}
+
+void OrderedFrameSink::Submit(int frameIndex, FrameBuffer* buffer)
+{
+	{
+		std::unique_lock<std::mutex> lock(reorderMutex);
+		windowCV.wait(lock, [this, frameIndex]() { return closing || frameIndex < nextFrame + ORDERED_SINK_WINDOW; });
+		reorder[frameIndex] = buffer;
+	}
+	reorderCV.notify_one();
+}
+
+void OrderedFrameSink::StartSequencer()
+{
+	nextFrame = firstFrame;
+	closing = false;
+	running = true;
+	sequencerThread = std::thread([this]() { SequencerThreadFunc(); });
+}
+
+void OrderedFrameSink::StopSequencer()
+{
+	if (!running)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(reorderMutex);
+		closing = true;
+	}
+	reorderCV.notify_one();
+	windowCV.notify_all();
+	sequencerThread.join();
+	running = false;
+}
+
+void OrderedFrameSink::SequencerThreadFunc()
+{
+	while (true)
+	{
+		FrameBuffer* buffer = nullptr;
+		int frameIndex;
+		{
+			//wait for the next frame in order, or once closing take whatever is next in line
+			std::unique_lock<std::mutex> lock(reorderMutex);
+			reorderCV.wait(lock, [this]() { return closing || reorder.count(nextFrame) != 0; });
+			if (reorder.empty())
+				break;
+			auto next = reorder.find(nextFrame);
+			if (next == reorder.end())
+				next = reorder.begin();
+			buffer = next->second;
+			frameIndex = next->first;
+			nextFrame = next->first + 1;
+			reorder.erase(next);
+		}
+		windowCV.notify_all();
+
+		//the write may block on a pipe or the disk, so it happens outside the lock
+		WriteFrameData(frameIndex, buffer);
+		m_writer->ReleaseBuffer(buffer);
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "FrameWriter.h"
+#include <map>
+
+//How far ahead of the frame being waited for a frame can be submitted before Submit blocks, so a slow frame
+//can't leave the rest of the animation piling up behind it
+#define ORDERED_SINK_WINDOW 16
+
+//Base for outputs that need frames strictly in order (video streams and containers). Frames can be
+//submitted from any thread in any order, they wait in a reorder buffer until every earlier frame has
+//been passed to WriteFrameData on the sink's own thread.
+class OrderedFrameSink
+{
+public:
+	OrderedFrameSink(FrameWriter* writer);
+	virtual ~OrderedFrameSink();
+
+	//Takes ownership of buffer, which goes back to the FrameWriter once written. Blocks while frameIndex is
+	//ORDERED_SINK_WINDOW or more frames past the next one to be written.
+	void Submit(int frameIndex, FrameBuffer* buffer);
+	//Frame the sequencer waits for first when it starts, for renders of part of an animation
+	void SetFirstFrame(int frameIndex) { firstFrame = frameIndex; }
+
+protected:
+	void StartSequencer();
+	//Writes everything still buffered, skipping any frames that never arrived, then stops the thread
+	void StopSequencer();
+	virtual void WriteFrameData(int frameIndex, FrameBuffer* buffer) = 0;
+
+	FrameWriter* m_writer;
+
+private:
+	void SequencerThreadFunc();
+
+	std::thread sequencerThread;
+	std::mutex reorderMutex;
+	std::condition_variable reorderCV;
+	std::condition_variable windowCV;
+	std::map<int, FrameBuffer*> reorder;
+	int nextFrame = 0;
+	int firstFrame = 0;
+	bool closing = false;
+	bool running = false;
+};
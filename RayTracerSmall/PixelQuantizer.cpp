@@ -0,0 +1,27 @@
+#include "PixelQuantizer.h"
+#include <algorithm>
+
+#if QUANTIZE_SSE2
+#include <emmintrin.h>
+#endif
+
+void PixelQuantizer::Quantize(const float* in, char* out, size_t count)
+{
+	size_t i = 0;
+#if QUANTIZE_SSE2
+	//16 floats at a time: clamp, scale, truncate to int, then saturating packs down to 16 bytes
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 scale = _mm_set1_ps(255.0f);
+	for (; i + 16 <= count; i += 16)
+	{
+		__m128i a = _mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_loadu_ps(in + i), one), scale));
+		__m128i b = _mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_loadu_ps(in + i + 4), one), scale));
+		__m128i c = _mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_loadu_ps(in + i + 8), one), scale));
+		__m128i d = _mm_cvttps_epi32(_mm_mul_ps(_mm_min_ps(_mm_loadu_ps(in + i + 12), one), scale));
+		__m128i bytes = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+		_mm_storeu_si128((__m128i*)(out + i), bytes);
+	}
+#endif
+	for (; i < count; ++i)
+		out[i] = (unsigned char)(std::min(1.0f, in[i]) * 255);
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define QUANTIZE_SSE2 1
+#else
+#define QUANTIZE_SSE2 0
+#endif
+
+//Float colour to byte conversion shared by every output path
+class PixelQuantizer
+{
+public:
+	//Clamps each channel to 1 and scales it to a byte, count is the number of floats (3 per pixel).
+	//Rounds the same way as the old per-channel cast, so output is identical whichever path runs.
+	static void Quantize(const float* in, char* out, size_t count);
+	static bool UsingSIMD() { return QUANTIZE_SSE2 != 0; }
+};
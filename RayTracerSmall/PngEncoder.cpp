@@ -0,0 +1,356 @@
+#include "PngEncoder.h"
+#include <cstdlib>
+#include <cstring>
+
+//Deflate length symbols 257-285 and distance symbols 0-29, base values and extra bits (RFC 1951 3.2.5)
+static const unsigned short lengthBase[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const unsigned char lengthExtra[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const unsigned short distBase[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+	4097, 6145, 8193, 12289, 16385, 24577 };
+static const unsigned char distExtra[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+#define DEFLATE_WINDOW 32768
+#define DEFLATE_MIN_MATCH 3
+#define DEFLATE_MAX_MATCH 258
+#define DEFLATE_HASH_BITS 15
+#define ADLER_MOD 65521
+
+//Packs deflate codes least significant bit first
+struct DeflateBits
+{
+	std::vector<unsigned char>* out;
+	unsigned buffer = 0;
+	int count = 0;
+
+	void Put(unsigned value, int bits)
+	{
+		buffer |= value << count;
+		count += bits;
+		while (count >= 8)
+		{
+			out->push_back((unsigned char)buffer);
+			buffer >>= 8;
+			count -= 8;
+		}
+	}
+	void Align()
+	{
+		if (count > 0)
+			out->push_back((unsigned char)buffer);
+		buffer = 0;
+		count = 0;
+	}
+};
+
+static unsigned ReverseBits(unsigned code, int length)
+{
+	unsigned reversed = 0;
+	for (int i = 0; i < length; i++)
+		reversed |= ((code >> i) & 1) << (length - 1 - i);
+	return reversed;
+}
+
+static void Put32BE(std::vector<unsigned char>& out, unsigned value)
+{
+	out.push_back((unsigned char)(value >> 24));
+	out.push_back((unsigned char)(value >> 16));
+	out.push_back((unsigned char)(value >> 8));
+	out.push_back((unsigned char)value);
+}
+
+static unsigned Adler32(const unsigned char* data, size_t length)
+{
+	unsigned a = 1;
+	unsigned b = 0;
+	while (length > 0)
+	{
+		//5552 is the most bytes that can be summed before b could overflow
+		size_t block = length < 5552 ? length : 5552;
+		length -= block;
+		while (block-- > 0)
+		{
+			a += *data++;
+			b += a;
+		}
+		a %= ADLER_MOD;
+		b %= ADLER_MOD;
+	}
+	return (b << 16) | a;
+}
+
+//Adler-32 of two buffers back to back, from the checksums of each and the length of the second
+static unsigned Adler32Combine(unsigned adler1, unsigned adler2, size_t length2)
+{
+	unsigned rem = (unsigned)(length2 % ADLER_MOD);
+	unsigned a1 = adler1 & 0xFFFF;
+	unsigned b1 = adler1 >> 16;
+	unsigned a2 = adler2 & 0xFFFF;
+	unsigned b2 = adler2 >> 16;
+	unsigned a = (a1 + a2 + ADLER_MOD - 1) % ADLER_MOD;
+	unsigned b = (unsigned)(((unsigned long long)rem * a1 + b1 + b2 + ADLER_MOD - rem) % ADLER_MOD);
+	return (b << 16) | a;
+}
+
+static unsigned char Paeth(int a, int b, int c)
+{
+	int p = a + b - c;
+	int pa = abs(p - a);
+	int pb = abs(p - b);
+	int pc = abs(p - c);
+	if (pa <= pb && pa <= pc)
+		return (unsigned char)a;
+	if (pb <= pc)
+		return (unsigned char)b;
+	return (unsigned char)c;
+}
+
+//Filters one row into out (filter type byte then the row), trying every filter and keeping the one
+//with the smallest sum of absolute residuals
+static void FilterRow(const unsigned char* row, const unsigned char* above, unsigned rowBytes, unsigned char* out, unsigned char* scratch)
+{
+	unsigned bestSum = ~0u;
+	for (int filter = 0; filter < 5; filter++)
+	{
+		unsigned sum = 0;
+		for (unsigned i = 0; i < rowBytes; i++)
+		{
+			int a = i >= 3 ? row[i - 3] : 0;
+			int b = above != nullptr ? above[i] : 0;
+			int c = (i >= 3 && above != nullptr) ? above[i - 3] : 0;
+			unsigned char predicted = 0;
+			switch (filter)
+			{
+			case 1: predicted = (unsigned char)a; break;
+			case 2: predicted = (unsigned char)b; break;
+			case 3: predicted = (unsigned char)((a + b) / 2); break;
+			case 4: predicted = Paeth(a, b, c); break;
+			}
+			unsigned char residual = (unsigned char)(row[i] - predicted);
+			scratch[i] = residual;
+			sum += residual < 128 ? residual : 256 - residual;
+		}
+		if (sum < bestSum)
+		{
+			bestSum = sum;
+			out[0] = (unsigned char)filter;
+			memcpy(out + 1, scratch, rowBytes);
+		}
+	}
+}
+
+PngEncoder::PngEncoder()
+{
+	for (unsigned n = 0; n < 256; n++)
+	{
+		unsigned c = n;
+		for (int k = 0; k < 8; k++)
+			c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+		crcTable[n] = c;
+	}
+
+	//fixed literal/length code (RFC 1951 3.2.6)
+	for (unsigned symbol = 0; symbol < 288; symbol++)
+	{
+		unsigned code;
+		int length;
+		if (symbol < 144)
+		{
+			code = 0x30 + symbol;
+			length = 8;
+		}
+		else if (symbol < 256)
+		{
+			code = 0x190 + symbol - 144;
+			length = 9;
+		}
+		else if (symbol < 280)
+		{
+			code = symbol - 256;
+			length = 7;
+		}
+		else
+		{
+			code = 0xC0 + symbol - 280;
+			length = 8;
+		}
+		litCodes[symbol] = (unsigned short)ReverseBits(code, length);
+		litLengths[symbol] = (unsigned char)length;
+	}
+}
+
+void PngEncoder::WriteChunk(std::vector<unsigned char>& out, const char* type, const unsigned char* data, size_t length)
+{
+	Put32BE(out, (unsigned)length);
+	size_t start = out.size();
+	out.insert(out.end(), type, type + 4);
+	out.insert(out.end(), data, data + length);
+
+	//the CRC covers the type and the data
+	unsigned crc = 0xFFFFFFFF;
+	for (size_t i = start; i < out.size(); i++)
+		crc = crcTable[(crc ^ out[i]) & 0xFF] ^ (crc >> 8);
+	Put32BE(out, crc ^ 0xFFFFFFFF);
+}
+
+//Greedy LZ77 over a hash chain, coded as one fixed Huffman block followed by an empty stored block so
+//the output ends byte aligned and the next strip's blocks can follow straight on
+void PngEncoder::Deflate(const unsigned char* data, size_t length, std::vector<unsigned char>& out)
+{
+	DeflateBits bits;
+	bits.out = &out;
+	bits.Put(0, 1);		//not the final block
+	bits.Put(1, 2);		//fixed Huffman codes
+
+	std::vector<int> head((size_t)1 << DEFLATE_HASH_BITS, -1);
+	std::vector<int> prev(length);
+	auto hash = [data](size_t i)
+	{
+		return ((data[i] << 10) ^ (data[i + 1] << 5) ^ data[i + 2]) & ((1 << DEFLATE_HASH_BITS) - 1);
+	};
+	auto insert = [&](size_t i)
+	{
+		if (i + DEFLATE_MIN_MATCH > length)
+			return;
+		int h = hash(i);
+		prev[i] = head[h];
+		head[h] = (int)i;
+	};
+
+	size_t i = 0;
+	while (i < length)
+	{
+		unsigned bestLength = 0;
+		unsigned bestDistance = 0;
+		if (i + DEFLATE_MIN_MATCH <= length)
+		{
+			size_t maxLength = length - i < DEFLATE_MAX_MATCH ? length - i : DEFLATE_MAX_MATCH;
+			int candidate = head[hash(i)];
+			for (int chain = 0; chain < PNG_MAX_CHAIN && candidate >= 0 && i - candidate <= DEFLATE_WINDOW; chain++)
+			{
+				unsigned matchLength = 0;
+				while (matchLength < maxLength && data[candidate + matchLength] == data[i + matchLength])
+					matchLength++;
+				if (matchLength > bestLength)
+				{
+					bestLength = matchLength;
+					bestDistance = (unsigned)(i - candidate);
+					if (matchLength == maxLength)
+						break;
+				}
+				candidate = prev[candidate];
+			}
+		}
+
+		if (bestLength >= DEFLATE_MIN_MATCH)
+		{
+			int lengthSymbol = 28;
+			while (lengthBase[lengthSymbol] > bestLength)
+				lengthSymbol--;
+			bits.Put(litCodes[257 + lengthSymbol], litLengths[257 + lengthSymbol]);
+			bits.Put(bestLength - lengthBase[lengthSymbol], lengthExtra[lengthSymbol]);
+
+			int distSymbol = 29;
+			while (distBase[distSymbol] > bestDistance)
+				distSymbol--;
+			bits.Put(ReverseBits(distSymbol, 5), 5);
+			bits.Put(bestDistance - distBase[distSymbol], distExtra[distSymbol]);
+
+			for (unsigned k = 0; k < bestLength; k++)
+				insert(i + k);
+			i += bestLength;
+		}
+		else
+		{
+			bits.Put(litCodes[data[i]], litLengths[data[i]]);
+			insert(i);
+			i++;
+		}
+	}
+	bits.Put(litCodes[256], litLengths[256]);
+
+	//empty stored block to get back onto a byte boundary
+	bits.Put(0, 3);
+	bits.Align();
+	out.push_back(0x00);
+	out.push_back(0x00);
+	out.push_back(0xFF);
+	out.push_back(0xFF);
+}
+
+unsigned PngEncoder::EncodeStrip(const unsigned char* rgb, unsigned width, unsigned height, unsigned strip, std::vector<unsigned char>& out)
+{
+	unsigned rowBytes = width * 3;
+	unsigned firstRow = strip * PNG_STRIP_ROWS;
+	unsigned rows = height - firstRow < PNG_STRIP_ROWS ? height - firstRow : PNG_STRIP_ROWS;
+
+	//filters only look back at the unfiltered image, so a strip can read the row above it directly
+	std::vector<unsigned char> filtered((size_t)rows * (rowBytes + 1));
+	std::vector<unsigned char> scratch(rowBytes);
+	for (unsigned r = 0; r < rows; r++)
+	{
+		unsigned y = firstRow + r;
+		const unsigned char* row = rgb + (size_t)y * rowBytes;
+		const unsigned char* above = y > 0 ? row - rowBytes : nullptr;
+		FilterRow(row, above, rowBytes, &filtered[(size_t)r * (rowBytes + 1)], scratch.data());
+	}
+
+	std::vector<unsigned char> compressed;
+	compressed.reserve(filtered.size() / 2);
+	//the first strip carries the zlib header: deflate, 32K window, no dictionary
+	if (strip == 0)
+	{
+		compressed.push_back(0x78);
+		compressed.push_back(0x01);
+	}
+	Deflate(filtered.data(), filtered.size(), compressed);
+
+	WriteChunk(out, "IDAT", compressed.data(), compressed.size());
+	return Adler32(filtered.data(), filtered.size());
+}
+
+void PngEncoder::Encode(const unsigned char* rgb, unsigned width, unsigned height, std::vector<unsigned char>& out, ThreadPool* pool)
+{
+	unsigned strips = (height + PNG_STRIP_ROWS - 1) / PNG_STRIP_ROWS;
+	std::vector<std::vector<unsigned char>> chunks(strips);
+	std::vector<unsigned> adlers(strips);
+	auto encodeStrip = [&](int strip)
+	{
+		adlers[strip] = EncodeStrip(rgb, width, height, strip, chunks[strip]);
+	};
+	if (pool != nullptr)
+		pool->ParallelFor((int)strips, encodeStrip);
+	else
+	{
+		for (unsigned strip = 0; strip < strips; strip++)
+			encodeStrip(strip);
+	}
+
+	out.clear();
+	static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	out.insert(out.end(), signature, signature + 8);
+
+	//8 bit truecolour, no interlacing
+	unsigned char header[13] = {
+		(unsigned char)(width >> 24), (unsigned char)(width >> 16), (unsigned char)(width >> 8), (unsigned char)width,
+		(unsigned char)(height >> 24), (unsigned char)(height >> 16), (unsigned char)(height >> 8), (unsigned char)height,
+		8, 2, 0, 0, 0 };
+	WriteChunk(out, "IHDR", header, sizeof(header));
+
+	unsigned adler = 1;
+	for (unsigned strip = 0; strip < strips; strip++)
+	{
+		out.insert(out.end(), chunks[strip].begin(), chunks[strip].end());
+		unsigned rows = height - strip * PNG_STRIP_ROWS < PNG_STRIP_ROWS ? height - strip * PNG_STRIP_ROWS : PNG_STRIP_ROWS;
+		adler = Adler32Combine(adler, adlers[strip], (size_t)rows * (width * 3 + 1));
+	}
+
+	//empty final fixed block then the zlib checksum
+	unsigned char trailer[6] = { 0x03, 0x00,
+		(unsigned char)(adler >> 24), (unsigned char)(adler >> 16), (unsigned char)(adler >> 8), (unsigned char)adler };
+	WriteChunk(out, "IDAT", trailer, sizeof(trailer));
+	WriteChunk(out, "IEND", nullptr, 0);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vector>
+#include "ThreadPool.h"
+
+//Image rows per independently compressed strip
+#define PNG_STRIP_ROWS 32
+//How many earlier positions with the same hash are tried when looking for a match
+#define PNG_MAX_CHAIN 32
+
+//Lossless rgb24 PNG encoder. Each strip of rows is filtered and deflated on its own and ends on a byte
+//boundary with an empty stored block, so strips are compressed in parallel across the ThreadPool and
+//written as consecutive IDAT chunks that together form one zlib stream.
+class PngEncoder
+{
+public:
+	PngEncoder();
+
+	//Encodes a width x height rgb24 image into out, which is cleared first. With a pool the strips are
+	//compressed in parallel, otherwise on the calling thread. Safe to call from several threads at once.
+	void Encode(const unsigned char* rgb, unsigned width, unsigned height, std::vector<unsigned char>& out, ThreadPool* pool);
+
+private:
+	//Writes a whole IDAT chunk for the strip into out and returns the Adler-32 of its filtered bytes
+	unsigned EncodeStrip(const unsigned char* rgb, unsigned width, unsigned height, unsigned strip, std::vector<unsigned char>& out);
+	void Deflate(const unsigned char* data, size_t length, std::vector<unsigned char>& out);
+	void WriteChunk(std::vector<unsigned char>& out, const char* type, const unsigned char* data, size_t length);
+
+	unsigned crcTable[256];
+	//fixed Huffman codes for literal/length symbols, bit reversed ready to write least significant bit first
+	unsigned short litCodes[288];
+	unsigned char litLengths[288];
+};
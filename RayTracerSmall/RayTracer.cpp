@@ -1,14 +1,12 @@
 #include "Raytracer.h"
 #include <sstream>
 #include <chrono>
+#include <cstring>
+#include <cstddef>
 
 Raytracer::Raytracer(ThreadPool* threads)
 {
-	invWidth = 1 / float(width);
-	invHeight = 1 / float(height);
-	aspectratio = width / float(height);
-	angle = tan(M_PI * 0.5 * fov / 180.0);
-	threadPool = threads;
+	Init(threads, RenderSettings());
 
 	json = JSONReader::LoadJSON("animation.json");
 	if (json != nullptr)
@@ -17,20 +15,154 @@ Raytracer::Raytracer(ThreadPool* threads)
 
 Raytracer::Raytracer(const char* jsonpath, ThreadPool* threads)
 {
+	Init(threads, RenderSettings());
+
+	json = SceneFile::LoadScene(jsonpath);
+	if (json != nullptr)
+		JSONRenderThreaded();
+}
+
+Raytracer::Raytracer(const char* jsonpath, ThreadPool* threads, const RenderSettings& renderSettings)
+{
+	Init(threads, renderSettings);
+
+	json = SceneFile::LoadScene(jsonpath);
+	if (json != nullptr)
+		JSONRenderThreaded();
+}
+
+Raytracer::Raytracer(ReadSphere* scene, ThreadPool* threads, const RenderSettings& renderSettings)
+{
+	Init(threads, renderSettings);
+
+	json = scene;
+	if (json != nullptr)
+		JSONRenderThreaded();
+}
+
+Raytracer::Raytracer(ThreadPool* threads, const RenderSettings& renderSettings)
+{
+	Init(threads, renderSettings);
+
+	json = nullptr;
+}
+
+void Raytracer::Init(ThreadPool* threads, const RenderSettings& renderSettings)
+{
+	settings = renderSettings;
+	width = settings.width;
+	height = settings.height;
+	size = width * height;
+	fov = settings.fov;
 	invWidth = 1 / float(width);
 	invHeight = 1 / float(height);
 	aspectratio = width / float(height);
 	angle = tan(M_PI * 0.5 * fov / 180.0);
 	threadPool = threads;
+	renderHeap = HeapDirector::CreateHeap("Render");
+	if (settings.outputFormat == OUTPUT_PFM && settings.fusedQuantize)
+	{
+		std::cout << "PFM output keeps the unclamped colour, so it can't be quantized while tracing" << std::endl;
+		settings.fusedQuantize = false;
+	}
+	if (settings.watch)
+	{
+		//edits patch frames in place, which only works when each frame is its own file
+		OutputFormat format = settings.outputFormat;
+		if (format != OUTPUT_PPM && format != OUTPUT_PPM_MAPPED && format != OUTPUT_PNG && format != OUTPUT_PFM)
+		{
+			std::cout << "Watching needs an output with a file per frame, writing PPM files instead" << std::endl;
+			settings.outputFormat = OUTPUT_PPM;
+		}
+		//the cache holds the frames that unchanged tiles are copied from
+		if (settings.cacheDirectory == nullptr)
+			settings.cacheDirectory = WATCH_CACHE_DIRECTORY;
+	}
+	framebufferHeap = HeapDirector::CreateMappedHeap("Framebuffer", FramebufferArenaBytes(settings, threadPool->GetSize()));
+	//the same two buffers a worker, plus a full batch waiting on the disk, before rendering waits for the writer.
+	//That's more than the workers and an ordered output's window can hold at once, so the frame an ordered
+	//output is waiting on always gets a buffer.
+	static_assert(ORDERED_SINK_WINDOW < FRAME_WRITER_QUEUE_DEPTH, "ordered outputs could hold every frame buffer");
+	frameWriter = new FrameWriter(framebufferHeap, (size_t)threadPool->GetSize() * 2 + FRAME_WRITER_QUEUE_DEPTH);
 
-	json = JSONReader::LoadJSON(jsonpath);
-	if (json != nullptr)
-		JSONRenderThreaded();
+	//only the output that was asked for gets its encoder or writer, the rest stay null
+	videoPipe = nullptr;
+	jpegEncoder = nullptr;
+	aviWriter = nullptr;
+	pngEncoder = nullptr;
+	frameArchive = nullptr;
+	//files holding the whole animation sit next to the frame directory, output.mp4 for output/
+	string outputName = settings.outputDirectory;
+	if (settings.outputFormat == OUTPUT_VIDEO_PIPE)
+	{
+		videoPipe = new VideoPipe(frameWriter);
+		videoPipe->SetFirstFrame(settings.firstFrame);
+		if (!videoPipe->Open(width, height, (outputName + ".mp4").c_str()))
+		{
+			std::cout << "ffmpeg is not available, writing PPM files instead" << std::endl;
+			settings.outputFormat = OUTPUT_PPM;
+			delete(videoPipe);
+			videoPipe = nullptr;
+		}
+	}
+	else if (settings.outputFormat == OUTPUT_MJPEG)
+	{
+		aviWriter = new AviWriter(frameWriter);
+		aviWriter->SetFirstFrame(settings.firstFrame);
+		if (aviWriter->Open(width, height, VIDEO_FRAMERATE, (outputName + ".avi").c_str()))
+		{
+			jpegEncoder = new JpegEncoder();
+		}
+		else
+		{
+			std::cout << "Could not create " << outputName << ".avi, writing PPM files instead" << std::endl;
+			settings.outputFormat = OUTPUT_PPM;
+			delete(aviWriter);
+			aviWriter = nullptr;
+		}
+	}
+	else if (settings.outputFormat == OUTPUT_ARCHIVE || settings.outputFormat == OUTPUT_DELTA)
+	{
+		frameArchive = new FrameArchiveWriter(frameWriter);
+		frameArchive->SetFirstFrame(settings.firstFrame);
+		int keyframeInterval = settings.outputFormat == OUTPUT_DELTA ? DELTA_KEYFRAME_INTERVAL : 0;
+		if (!frameArchive->Open(width, height, (outputName + ".rtfa").c_str(), keyframeInterval))
+		{
+			std::cout << "Could not create " << outputName << ".rtfa, writing PPM files instead" << std::endl;
+			settings.outputFormat = OUTPUT_PPM;
+			delete(frameArchive);
+			frameArchive = nullptr;
+		}
+	}
+	else if (settings.outputFormat == OUTPUT_PNG)
+	{
+		pngEncoder = new PngEncoder();
+	}
+	frameCache = settings.cacheDirectory != nullptr ? new FrameCache(settings.cacheDirectory) : nullptr;
+}
+
+// Room for two frames per worker so recycled buffers never run the arena dry. Each frame is its output
+// bytes plus, unless fused quantizing, the traced image as Vec3f or half floats
+size_t Raytracer::FramebufferArenaBytes(const RenderSettings& settings, int workers)
+{
+	bool pfm = settings.outputFormat == OUTPUT_PFM;
+	size_t frameBytes = pfm ? sizeof(Vec3f) : 3 * sizeof(char);
+	//Init turns fused quantizing off for PFM
+	if (!settings.fusedQuantize || pfm)
+		frameBytes += settings.halfFramebuffer ? 3 * sizeof(unsigned short) : sizeof(Vec3f);
+	return (size_t)workers * 2 * settings.width * settings.height * frameBytes;
 }
 
 Raytracer::~Raytracer()
 {
 	delete(json);
+	delete(videoPipe);
+	delete(aviWriter);
+	delete(jpegEncoder);
+	delete(pngEncoder);
+	delete(frameArchive);
+	delete(frameCache);
+	delete(frameWriter);
 }
 
 float Raytracer::mix(const float& a, const float& b, const float& mix)
@@ -46,27 +178,30 @@ float Raytracer::mix(const float& a, const float& b, const float& mix)
 // The function returns a color for the ray. If the ray intersects an object that
 // is the color of the object at the intersection point, otherwise it returns
 // the background color.
-Vec3f Raytracer::Trace(const Vec3f& rayorig, const Vec3f& raydir, const std::vector<Sphere>& spheres, const int& depth)
+Vec3f Raytracer::Trace(const Vec3f& rayorig, const Vec3f& raydir, const FrameSpheres& scene, const int& depth)
 {
 	//if (raydir.length() != 1) std::cerr << "Error " << raydir << std::endl;
+	unsigned sphereCount = scene.Size();
 	float tnear = INFINITY;
-	const Sphere* sphere = NULL;
+	unsigned sphere = sphereCount;
 	// find intersection of this ray with the sphere in the scene
-	for (unsigned i = 0; i < spheres.size(); ++i) {
+	for (unsigned i = 0; i < sphereCount; ++i) {
 		float t0 = INFINITY, t1 = INFINITY;
-		if (spheres[i].intersect(rayorig, raydir, t0, t1)) {
+		if (scene.Intersect(i, rayorig, raydir, t0, t1)) {
 			if (t0 < 0) t0 = t1;
 			if (t0 < tnear) {
 				tnear = t0;
-				sphere = &spheres[i];
+				sphere = i;
 			}
 		}
 	}
 	// if there's no intersection return black or background color
-	if (!sphere) return Vec3f(2);
+	if (sphere == sphereCount) return Vec3f(2);
+	// only the sphere that was hit needs its material
+	const Material& material = scene.GetMaterial(sphere);
 	Vec3f surfaceColor = 0; // color of the ray/surfaceof the object intersected by the ray
 	Vec3f phit = rayorig + raydir * tnear; // point of intersection
-	Vec3f nhit = phit - sphere->center; // normal at the intersection point
+	Vec3f nhit = phit - scene.GetCenter(sphere); // normal at the intersection point
 	nhit.normalize(); // normalize normal direction
 	// If the normal and the view direction are not opposite to each other
 	// reverse the normal direction. That also means we are inside the sphere so set
@@ -75,7 +210,7 @@ Vec3f Raytracer::Trace(const Vec3f& rayorig, const Vec3f& raydir, const std::vec
 	float bias = 1e-4; // add some bias to the point from which we will be tracing
 	bool inside = false;
 	if (raydir.dot(nhit) > 0) nhit = -nhit, inside = true;
-	if ((sphere->transparency > 0 || sphere->reflection > 0) && depth < MAX_RAY_DEPTH)
+	if ((material.transparency > 0 || material.reflection > 0) && depth < MAX_RAY_DEPTH)
 	{
 		float facingratio = -raydir.dot(nhit);
 		// change the mix value to tweak the effect
@@ -84,137 +219,366 @@ Vec3f Raytracer::Trace(const Vec3f& rayorig, const Vec3f& raydir, const std::vec
 		// are already normalized)
 		Vec3f refldir = raydir - nhit * 2 * raydir.dot(nhit);
 		refldir.normalize();
-		Vec3f reflection = Trace(phit + nhit * bias, refldir, spheres, depth + 1);
+		Vec3f reflection = Trace(phit + nhit * bias, refldir, scene, depth + 1);
 		Vec3f refraction = 0;
 		// if the sphere is also transparent compute refraction ray (transmission)
-		if (sphere->transparency) {
+		if (material.transparency) {
 			float ior = 1.1, eta = (inside) ? ior : 1 / ior; // are we inside or outside the surface?
 			float cosi = -nhit.dot(raydir);
 			float k = 1 - eta * eta * (1 - cosi * cosi);
 			Vec3f refrdir = raydir * eta + nhit * (eta * cosi - sqrt(k));
 			refrdir.normalize();
-			refraction = Trace(phit - nhit * bias, refrdir, spheres, depth + 1);
+			refraction = Trace(phit - nhit * bias, refrdir, scene, depth + 1);
 		}
 		// the result is a mix of reflection and refraction (if the sphere is transparent)
 		surfaceColor = (
 			reflection * fresneleffect +
-			refraction * (1 - fresneleffect) * sphere->transparency) * sphere->surfaceColor;
+			refraction * (1 - fresneleffect) * material.transparency) * material.surfaceColor;
 	}
 	else {
 		// it's a diffuse object, no need to raytrace any further
-		for (unsigned i = 0; i < spheres.size(); ++i) {
-			if (spheres[i].emissionColor.x > 0) {
-				// this is a light
-				Vec3f transmission = 1;
-				Vec3f lightDirection = spheres[i].center - phit;
-				lightDirection.normalize();
-				for (unsigned j = 0; j < spheres.size(); ++j) {
-					if (i != j) {
-						float t0, t1;
-						if (spheres[j].intersect(phit + nhit * bias, lightDirection, t0, t1)) {
-							transmission = 0;
-							break;
-						}
+		for (unsigned l = 0; l < scene.lights.size(); ++l) {
+			// this is a light
+			unsigned i = scene.lights[l];
+			Vec3f transmission = 1;
+			Vec3f lightDirection = scene.GetCenter(i) - phit;
+			lightDirection.normalize();
+			for (unsigned j = 0; j < sphereCount; ++j) {
+				if (i != j) {
+					float t0, t1;
+					if (scene.Intersect(j, phit + nhit * bias, lightDirection, t0, t1)) {
+						transmission = 0;
+						break;
 					}
 				}
-				surfaceColor += sphere->surfaceColor * transmission *
-					std::max(float(0), nhit.dot(lightDirection)) * spheres[i].emissionColor;
 			}
+			surfaceColor += material.surfaceColor * transmission *
+				std::max(float(0), nhit.dot(lightDirection)) * scene.GetMaterial(i).emissionColor;
 		}
 	}
 
-	return surfaceColor + sphere->emissionColor;
+	return surfaceColor + material.emissionColor;
 }
 
 // Main rendering function. We compute a camera ray for each pixel of the image
 // trace it and return a color. If the ray hits a sphere, we return the color of the
 // sphere at the intersection point, else we return the background color.
-void Raytracer::Render(const std::vector<Sphere>& spheres, int iteration)
+void Raytracer::Render(int iteration)
 {
-	Vec3f* image = new Vec3f[size];
-	Vec3f* pixel = image;
+	HeapScope heapScope(renderHeap);
+	// let the pool's lock go first, waiting on a buffer or mapping a file here would hold up every worker,
+	// and evaluating the frame after it means workers aren't queued behind each other's evaluation
+	ReleasePoolLock();
+	FrameTarget target;
+	BeginFrame(iteration, target);
+	RenderFrame(EvaluateFrame(iteration), target);
+}
 
+// Trace (or fetch from the cache) one evaluated frame into target and send it on its way
+void Raytracer::RenderFrame(const FrameSpheres& spheres, FrameTarget& target)
+{
+	// Frames already in the cache are loaded straight into the output instead of traced
+	unsigned long long cacheKey = 0;
+	bool cached = false;
+	if (frameCache != nullptr)
+	{
+		cacheKey = FrameCache::Key(spheres, settings, target.pixelBytes);
+		cached = frameCache->Load(cacheKey, target.pixels, target.pixelBytes);
+	}
+	if (!cached)
+	{
+		TraceFrame(spheres, target);
+		if (frameCache != nullptr)
+			frameCache->Store(cacheKey, target.pixels, target.pixelBytes);
+	}
 
-#ifdef _WIN32
-	threadPool->ReleaseLock();
-#else
-	if (LINUX_POOLING)
-		threadPool->ReleaseLock();
-#endif // !_WIN32
+	auto start = std::chrono::high_resolution_clock::now();
 
+	EndFrame(target);
 
-	// Trace rays
-	for (unsigned y = 0; y < height; ++y)
+	auto stop = std::chrono::high_resolution_clock::now();
+	auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start);
+	long long totalTime = outputTime += duration.count();
+	int count = ++framesOutput;
+	std::stringstream msg;
+	msg << "Spheres" << target.iteration << ".ppm has been rendered and output : \\Average time: " << totalTime / count << "ms\n";
+	std::cout << msg.str();
+}
+
+// Trace every pixel and leave the frame's output pixels in target
+void Raytracer::TraceFrame(const FrameSpheres& spheres, FrameTarget& target)
+{
+	if (settings.fusedQuantize)
 	{
-		for (unsigned x = 0; x < width; ++x, ++pixel)
+		// Trace a tile at a time into a small stack buffer and quantize it straight into the output, so
+		// the frame never exists as floats
+		NoAllocRegion noAlloc("Render pixel loop");
+		Vec3f tile[RENDER_TILE_PIXELS];
+		char* out = target.pixels;
+		for (unsigned y = 0; y < height; ++y)
 		{
-			float xx = (2 * ((x + 0.5) * invWidth) - 1) * angle * aspectratio;
-			float yy = (1 - 2 * ((y + 0.5) * invHeight)) * angle;
-			Vec3f raydir(xx, yy, -1);
-			raydir.normalize();
-			*pixel = Trace(Vec3f(0), raydir, spheres, 0);
+			for (unsigned tileX = 0; tileX < width; tileX += RENDER_TILE_PIXELS)
+			{
+				unsigned tileWidth = std::min(width - tileX, (unsigned)RENDER_TILE_PIXELS);
+				for (unsigned i = 0; i < tileWidth; ++i)
+					tile[i] = TracePixel(tileX + i, y, spheres);
+				PixelQuantizer::Quantize(&tile[0].x, out, tileWidth * 3);
+				out += tileWidth * 3;
+			}
 		}
 	}
+	else if (settings.halfFramebuffer)
+	{
+		// Same tiles, packed to half floats to keep the HDR image in half the memory of Vec3f
+		unsigned short* image = new (framebufferHeap) unsigned short[size * 3];
+		{
+			NoAllocRegion noAlloc("Render pixel loop");
+			Vec3f tile[RENDER_TILE_PIXELS];
+			unsigned short* out = image;
+			for (unsigned y = 0; y < height; ++y)
+			{
+				for (unsigned tileX = 0; tileX < width; tileX += RENDER_TILE_PIXELS)
+				{
+					unsigned tileWidth = std::min(width - tileX, (unsigned)RENDER_TILE_PIXELS);
+					for (unsigned i = 0; i < tileWidth; ++i)
+						tile[i] = TracePixel(tileX + i, y, spheres);
+					HalfFloat::Pack(&tile[0].x, out, tileWidth * 3);
+					out += tileWidth * 3;
+				}
+			}
+		}
+		OutputHalfPixels(image, target);
+		delete[] image;
+	}
+	else
+	{
+		Vec3f* image = new (framebufferHeap) Vec3f[size];
+		Vec3f* pixel = image;
 
-	auto start = std::chrono::high_resolution_clock::now();
+		// Trace rays, the pixel loop and Trace must never allocate
+		{
+			NoAllocRegion noAlloc("Render pixel loop");
+			for (unsigned y = 0; y < height; ++y)
+			{
+				for (unsigned x = 0; x < width; ++x, ++pixel)
+				{
+					*pixel = TracePixel(x, y, spheres);
+				}
+			}
+		}
+		if (settings.outputFormat == OUTPUT_PFM)
+		{
+			// PFM rows run bottom to top
+			for (unsigned y = 0; y < height; ++y)
+				memcpy(target.pixels + (size_t)(height - 1 - y) * width * sizeof(Vec3f), image + (size_t)y * width, width * sizeof(Vec3f));
+		}
+		else
+			QuantizePixels(image, target.pixels);
+		delete[] image;
+	}
+}
 
-	// Save result to a PPM image (keep these flags if you compile under Windows)
-	string fileName = "output/spheres" + std::to_string(iteration) + ".ppm";
-	std::ofstream ofs(fileName, std::ios::out | std::ios::binary);
+// Direction of the primary ray through the centre of pixel (x, y)
+Vec3f Raytracer::PrimaryRay(unsigned x, unsigned y)
+{
+	float xx = (2 * ((x + 0.5) * invWidth) - 1) * angle * aspectratio;
+	float yy = (1 - 2 * ((y + 0.5) * invHeight)) * angle;
+	Vec3f raydir(xx, yy, -1);
+	raydir.normalize();
+	return raydir;
+}
+
+Vec3f Raytracer::TracePixel(unsigned x, unsigned y, const FrameSpheres& spheres)
+{
+	return Trace(Vec3f(0), PrimaryRay(x, y), spheres, 0);
+}
+
+// Clamp each channel to 1 and scale to a byte, three bytes per pixel
+void Raytracer::QuantizePixels(const Vec3f* image, char* out)
+{
+	static_assert(sizeof(Vec3f) == 3 * sizeof(float), "Vec3f must be three packed floats to quantize it as a flat array");
+	PixelQuantizer::Quantize(&image[0].x, out, (size_t)size * 3);
+}
 
+// Turn a half float frame into the output's pixels, a tile at a time through floats
+void Raytracer::OutputHalfPixels(const unsigned short* image, FrameTarget& target)
+{
+	float tile[RENDER_TILE_PIXELS * 3];
+	for (unsigned y = 0; y < height; ++y)
+	{
+		for (unsigned tileX = 0; tileX < width; tileX += RENDER_TILE_PIXELS)
+		{
+			unsigned tileWidth = std::min(width - tileX, (unsigned)RENDER_TILE_PIXELS);
+			size_t pixel = (size_t)y * width + tileX;
+			if (settings.outputFormat == OUTPUT_PFM)
+			{
+				// PFM rows run bottom to top
+				float* out = (float*)target.pixels + ((size_t)(height - 1 - y) * width + tileX) * 3;
+				HalfFloat::Unpack(image + pixel * 3, out, tileWidth * 3);
+			}
+			else
+			{
+				HalfFloat::Unpack(image + pixel * 3, tile, tileWidth * 3);
+				PixelQuantizer::Quantize(tile, target.pixels + pixel * 3, tileWidth * 3);
+			}
+		}
+	}
+}
+
+// Decide where this frame's rgb24 bytes will live before it's traced, so they're quantized straight into
+// the frame writer buffer or file mapping they leave in rather than being copied there afterwards
+void Raytracer::BeginFrame(int iteration, FrameTarget& target)
+{
+	target.iteration = iteration;
+	target.buffer = nullptr;
+	target.fileName = FramePath(iteration, ".ppm");
 	string line = "P6\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
-	ofs.write(line.c_str(), line.length());
-	//ofs << "P6\n" << width << " " << height << "\n255\n";
-	char* charArr = new char[size * 3];
-	int index = 0;
-	for (unsigned i = 0; i < size; ++i, index += 3)
+
+	switch (settings.outputFormat)
 	{
-		charArr[index] = (unsigned char)(std::min(1.0f, image[i].x) * 255);
-		charArr[index + 1] = (unsigned char)(std::min(1.0f, image[i].y) * 255);
-		charArr[index + 2] = (unsigned char)(std::min(1.0f, image[i].z) * 255);
+	case OUTPUT_VIDEO_PIPE:
+	case OUTPUT_MJPEG:
+	case OUTPUT_PNG:
+	case OUTPUT_ARCHIVE:
+	case OUTPUT_DELTA:
+		//bare rgb24 for the pipe or the encoders
+		target.buffer = frameWriter->AcquireBuffer(size * 3);
+		target.buffer->length = size * 3;
+		target.pixels = target.buffer->data;
+		target.pixelBytes = size * 3;
+		return;
+	case OUTPUT_PFM:
+	{
+		//little endian floats (the negative scale says so), three per pixel
+		target.fileName = FramePath(iteration, ".pfm");
+		string pfmLine = "PF\n" + std::to_string(width) + " " + std::to_string(height) + "\n-1.0\n";
+		target.buffer = frameWriter->AcquireBuffer(pfmLine.length() + size * sizeof(Vec3f));
+		memcpy(target.buffer->data, pfmLine.c_str(), pfmLine.length());
+		target.buffer->length = pfmLine.length() + size * sizeof(Vec3f);
+		target.pixels = target.buffer->data + pfmLine.length();
+		target.pixelBytes = size * sizeof(Vec3f);
+		return;
+	}
+	case OUTPUT_PPM_MAPPED:
+		//size the file up front and write into a mapping of it, skipping the stream copy
+		if (target.mapped.Open(target.fileName.c_str(), line.length() + size * 3))
+		{
+			memcpy(target.mapped.GetData(), line.c_str(), line.length());
+			target.pixels = target.mapped.GetData() + line.length();
+			target.pixelBytes = size * 3;
+			return;
+		}
+		//mapping isn't possible here, so fall back to the async writer
+		break;
+	default:
+		break;
 	}
-	ofs.write(charArr, size * 3);
-	/*for (unsigned i = 0; i < size; ++i)
+
+	target.buffer = frameWriter->AcquireBuffer(line.length() + size * 3);
+	memcpy(target.buffer->data, line.c_str(), line.length());
+	target.buffer->length = line.length() + size * 3;
+	target.pixels = target.buffer->data + line.length();
+	target.pixelBytes = size * 3;
+}
+
+// Send the finished frame on its way, whoever it's handed to owns the bytes from here
+void Raytracer::EndFrame(FrameTarget& target)
+{
+	if (target.buffer == nullptr)
 	{
-		ofs << (unsigned char)(std::min(1.0f, image[i].x) * 255) <<
-		(unsigned char)(std::min(1.0f, image[i].y) * 255) <<
-		(unsigned char)(std::min(1.0f, image[i].z) * 255);
-	}*/
+		target.mapped.Close();
+		return;
+	}
 
-	ofs.close();
-	delete[] image;
+	switch (settings.outputFormat)
+	{
+	case OUTPUT_VIDEO_PIPE:
+		//the pipe writes the frames out in order
+		videoPipe->Submit(target.iteration, target.buffer);
+		break;
+	case OUTPUT_MJPEG:
+		WriteMjpegFrame(target.buffer, target.iteration);
+		break;
+	case OUTPUT_ARCHIVE:
+	case OUTPUT_DELTA:
+		frameArchive->Submit(target.iteration, target.buffer);
+		break;
+	case OUTPUT_PNG:
+		WritePNG(target.buffer, FramePath(target.iteration, ".png"));
+		break;
+	default:
+		//P6 or PFM written on the frame writer's own thread
+		frameWriter->Submit(target.buffer, target.fileName);
+		break;
+	}
+}
 
-	auto stop = std::chrono::high_resolution_clock::now();
-	auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start);
-	static long avgTime = 0;
-	static int count = 0;
-	avgTime += duration.count();
-	count++;
-	std::stringstream msg;
-	msg << "Spheres" << iteration << ".ppm has been rendered and saved : \\Average time: " << avgTime / count << "ms\n";
-	std::cout << msg.str();
+// Save result to a lossless PNG, its strips compressed across the pool, and let the frame writer write the file
+void Raytracer::WritePNG(FrameBuffer* rgb, const string& fileName)
+{
+	std::vector<unsigned char> png;
+	pngEncoder->Encode((const unsigned char*)rgb->data, width, height, png, threadPool);
+	frameWriter->ReleaseBuffer(rgb);
+
+	FrameBuffer* frame = frameWriter->AcquireBuffer(png.size());
+	memcpy(frame->data, png.data(), png.size());
+	frame->length = png.size();
+	frameWriter->Submit(frame, fileName);
+}
+
+// JPEG encode the frame here, its MCU rows spread across the pool, and hand it to the AVI writer to put in order
+void Raytracer::WriteMjpegFrame(FrameBuffer* rgb, int iteration)
+{
+	std::vector<unsigned char> jpeg;
+	jpegEncoder->Encode((const unsigned char*)rgb->data, width, height, jpeg, threadPool);
+	frameWriter->ReleaseBuffer(rgb);
+
+	FrameBuffer* frame = frameWriter->AcquireBuffer(jpeg.size());
+	memcpy(frame->data, jpeg.data(), jpeg.size());
+	frame->length = jpeg.size();
+	aviWriter->Submit(iteration, frame);
+}
+
+string Raytracer::FramePath(int iteration, const char* extension)
+{
+	return string(settings.outputDirectory) + "/spheres" + std::to_string(iteration) + extension;
+}
+
+// Tasks hold the pool's lock when they start and have to let it go once they no longer need it
+void Raytracer::ReleasePoolLock()
+{
+#ifdef _WIN32
+	threadPool->ReleaseLock();
+#else
+	if (LINUX_POOLING)
+		threadPool->ReleaseLock();
+#endif // !_WIN32
+}
+
+// Frames don't depend on each other, so any range of them can be rendered on its own
+void Raytracer::GetFrameRange(int& first, int& last)
+{
+	first = settings.firstFrame;
+	last = settings.lastFrame < 0 || settings.lastFrame >= json->frameCount ? json->frameCount - 1 : settings.lastFrame;
+}
+
+// Each worker evaluates its frames into the same buffer, so memory stays at one frame of spheres per thread.
+// Large scenes are split across the pool, so call this after the task has released the pool's lock.
+const FrameSpheres& Raytracer::EvaluateFrame(int iteration)
+{
+	thread_local FrameSpheres frameSpheres;
+	json->EvaluateFrame(iteration, frameSpheres, threadPool);
+	return frameSpheres;
 }
 
 void Raytracer::JSONRender(int iteration)
 {
-	std::vector<Sphere> spheresVec = std::vector<Sphere>();
-	for (int j = 0; j < json->sphereAmount; j++)
-	{
-		spheresVec.push_back(json->spheres[j]);
-		json->spheres[j].center += json->movement[j];
-		json->spheres[j].surfaceColor += json->colourChange[j];
-		json->spheres[j].radius += json->radChange[j];
-		json->spheres[j].radius2 = json->spheres[j].radius * json->spheres[j].radius;
-		/*if(j == 1)
-		{
-			std::stringstream m;
-			m << "Centre: " << json->movement[j] << ", SurfaceColour: " << json->colourChange[j] << ", Radius: "<< json->radiusChange[j] << std::endl;
-			std::cout << m.str();
-		}*/
-	}
-	threadPool->Enqueue([this, iteration, spheresVec]
+	//only the frame number is queued, the spheres are worked out from the shared scene once a worker picks it up
+	framesQueued++;
+	threadPool->Enqueue([this, iteration]
 		{
-			Render(spheresVec, iteration);
+			Render(iteration);
+			FrameDone();
 		});
 	//Render(spheresVec, iteration);
 	//spheresVec.clear();
@@ -225,10 +589,354 @@ void Raytracer::JSONRender(int iteration)
 
 void Raytracer::JSONRenderThreaded()
 {
-	for (int i = 0; i < json->frameCount; i++)
+	QueueFrames();
+	FinishFrames();
+}
+
+void Raytracer::QueueFrames()
+{
+	int first, last;
+	GetFrameRange(first, last);
+	if (first > last)
+	{
+		std::stringstream msg;
+		msg << "No frames to render, the scene has " << json->frameCount << " frames\n";
+		std::cout << msg.str();
+		return;
+	}
+	for (int i = first; i <= last; i++)
 	{
 		JSONRender(i);
 		//threadPool->Enqueue([this, i] { JSONRender(i); });
 	}
-	threadPool->WaitUntilCompleted();
-}
\ No newline at end of file
+}
+
+// The last frame out wakes FinishFrames, other raytracers' frames can still be in the pool
+void Raytracer::FrameDone()
+{
+	//counted down and notified under the lock, so FinishFrames can't see 0 and destroy this raytracer until
+	//the notify is done with it
+	std::lock_guard<std::mutex> guard(framesMutex);
+	if (--framesQueued == 0)
+		framesDone.notify_all();
+}
+
+void Raytracer::FinishFrames()
+{
+#ifndef _WIN32
+	if (!LINUX_POOLING)
+	{
+		//forked frames can't count themselves off, so wait for every fork
+		threadPool->WaitUntilCompleted();
+		framesQueued = 0;
+	}
+#endif // !_WIN32
+	{
+		std::unique_lock<std::mutex> lock(framesMutex);
+		framesDone.wait(lock, [this]() { return framesQueued == 0; });
+	}
+	frameWriter->Flush();
+	if (videoPipe != nullptr)
+		videoPipe->Close();
+	if (aviWriter != nullptr)
+		aviWriter->Close();
+	if (frameArchive != nullptr)
+		frameArchive->Close();
+
+	if (frameCache != nullptr)
+	{
+		std::stringstream msg;
+		msg << "Frame cache: " << frameCache->GetHits() << " frames reused, " << frameCache->GetMisses() << " traced\n";
+		std::cout << msg.str();
+	}
+}
+// Watch the scene file and, after each edit, re-render only the frames and tiles the edit changed. The
+// pool, the frame writer and the cache carry over from one edit to the next.
+void Raytracer::Watch()
+{
+	SceneWatcher watcher;
+	if (!watcher.Open(settings.scenePath))
+	{
+		std::cout << "Unable to watch " << settings.scenePath << std::endl;
+		return;
+	}
+	std::cout << "Watching " << settings.scenePath << " for changes, Ctrl+C to stop" << std::endl;
+
+	while (watcher.WaitForChange())
+	{
+		ReadSphere* scene = SceneFile::LoadScene(settings.scenePath);
+		if (scene == nullptr)
+		{
+			std::cout << "Keeping the previous scene until the file loads again" << std::endl;
+			continue;
+		}
+
+		auto start = std::chrono::high_resolution_clock::now();
+		ReadSphere* previous = json;
+		json = scene;
+		watchFramesChanged = 0;
+		watchTilesTraced = 0;
+		watchTilesTotal = 0;
+
+		int first, last;
+		GetFrameRange(first, last);
+		for (int i = first; i <= last; i++)
+		{
+			threadPool->Enqueue([this, previous, i]
+				{
+					RenderChanges(previous, i);
+				});
+		}
+		if (first <= last)
+			threadPool->WaitUntilCompleted();
+		frameWriter->Flush();
+		delete(previous);
+
+		auto stop = std::chrono::high_resolution_clock::now();
+		std::stringstream msg;
+		msg << "Scene changed: " << watchFramesChanged << " of " << (last - first + 1) << " frames re-rendered, " << watchTilesTraced
+			<< " of " << watchTilesTotal << " tiles traced, " << std::chrono::duration_cast<std::chrono::milliseconds>(stop - start).count() << "ms\n";
+		//watching goes on indefinitely, so don't leave the report sitting in the buffer
+		std::cout << msg.str() << std::flush;
+	}
+}
+
+// Bring one frame up to date with the new scene: skipped if none of its spheres changed, otherwise the old
+// frame comes out of the cache and only the tiles the changed spheres can reach are traced again
+void Raytracer::RenderChanges(const ReadSphere* previous, int iteration)
+{
+	//watch mode only writes frames that can be finished in any order, so the lock isn't needed past here
+	ReleasePoolLock();
+	thread_local FrameSpheres before;
+	const FrameSpheres& after = EvaluateFrame(iteration);
+	bool comparable = previous->sphereAmount == json->sphereAmount && iteration < previous->frameCount;
+	std::vector<int> changed;
+	if (comparable)
+	{
+		previous->EvaluateFrame(iteration, before, threadPool);
+		//material indices can shift between scenes, so it's what the sphere's material holds that's compared
+		for (int i = 0; i < json->sphereAmount; i++)
+		{
+			CompactSphere was = before.GetSphere(i), is = after.GetSphere(i);
+			if (memcmp(&was, &is, offsetof(CompactSphere, material)) != 0 ||
+				memcmp(&before.GetMaterial(i), &after.GetMaterial(i), sizeof(Material)) != 0)
+				changed.push_back(i);
+		}
+		if (changed.empty())
+			return;
+	}
+	watchFramesChanged++;
+
+	HeapScope heapScope(renderHeap);
+	FrameTarget target;
+	BeginFrame(iteration, target);
+	if (!comparable)
+	{
+		RenderFrame(after, target);
+		return;
+	}
+
+	std::vector<char> dirty;
+	int tileCount = ((width + WATCH_TILE_SIZE - 1) / WATCH_TILE_SIZE) * ((height + WATCH_TILE_SIZE - 1) / WATCH_TILE_SIZE);
+	watchTilesTotal += tileCount;
+	if (frameCache->Load(FrameCache::Key(before, settings, target.pixelBytes), target.pixels, target.pixelBytes))
+	{
+		watchTilesTraced += FindDirtyTiles(before, after, changed, dirty);
+		TraceTiles(after, dirty, target);
+	}
+	else
+	{
+		//nothing to patch, so the whole frame is traced
+		watchTilesTraced += tileCount;
+		TraceFrame(after, target);
+	}
+	frameCache->Store(FrameCache::Key(after, settings, target.pixelBytes), target.pixels, target.pixelBytes);
+	EndFrame(target);
+}
+
+// Marks the tiles whose pixels the changed spheres might alter, and returns how many. Worked out from the
+// primary hits of the frame as it was: a tile is kept when none of its rays can meet a changed sphere.
+//  - primary rays: tiles under the screen bounds of any changed sphere, before or after the change
+//  - reflection and refraction go anywhere, so tiles that hit a reflective or transparent sphere always
+//  - shadow rays run from the diffuse hits through each light, so tiles are tested against that cone
+int Raytracer::FindDirtyTiles(const FrameSpheres& before, const FrameSpheres& after, const std::vector<int>& changed, std::vector<char>& dirty)
+{
+	unsigned tilesX = (width + WATCH_TILE_SIZE - 1) / WATCH_TILE_SIZE;
+	unsigned tilesY = (height + WATCH_TILE_SIZE - 1) / WATCH_TILE_SIZE;
+	dirty.assign(tilesX * tilesY, 0);
+
+	//every state the changed spheres were or are in, and whether any of them lights the scene
+	std::vector<CompactSphere> moved;
+	bool lightChanged = false;
+	for (int i : changed)
+	{
+		moved.push_back(before.GetSphere(i));
+		moved.push_back(after.GetSphere(i));
+		lightChanged |= before.GetMaterial(i).emissionColor.x > 0 || after.GetMaterial(i).emissionColor.x > 0;
+	}
+
+	//screen bounds from the extremes of x/depth and y/depth over each sphere's bounding box
+	for (const CompactSphere& sphere : moved)
+	{
+		float radius = sqrtf(sphere.radius2);
+		float nearDepth = -sphere.center.z - radius;
+		float farDepth = -sphere.center.z + radius;
+		if (farDepth <= 0)
+			continue;
+		float left = 0, right = (float)width, top = 0, bottom = (float)height;
+		if (nearDepth > 1e-3f)
+		{
+			float x0 = sphere.center.x - radius, x1 = sphere.center.x + radius;
+			float y0 = sphere.center.y - radius, y1 = sphere.center.y + radius;
+			float minX = x0 / (x0 < 0 ? nearDepth : farDepth), maxX = x1 / (x1 > 0 ? nearDepth : farDepth);
+			float minY = y0 / (y0 < 0 ? nearDepth : farDepth), maxY = y1 / (y1 > 0 ? nearDepth : farDepth);
+			left = (minX / (angle * aspectratio) + 1) * width * 0.5f - 1.5f;
+			right = (maxX / (angle * aspectratio) + 1) * width * 0.5f + 0.5f;
+			top = (1 - maxY / angle) * height * 0.5f - 1.5f;
+			bottom = (1 - minY / angle) * height * 0.5f + 0.5f;
+		}
+		if (right < 0 || bottom < 0 || left >= width || top >= height)
+			continue;
+		unsigned tileLeft = left <= 0 ? 0 : (unsigned)left / WATCH_TILE_SIZE;
+		unsigned tileRight = right >= width ? tilesX - 1 : (unsigned)right / WATCH_TILE_SIZE;
+		unsigned tileTop = top <= 0 ? 0 : (unsigned)top / WATCH_TILE_SIZE;
+		unsigned tileBottom = bottom >= height ? tilesY - 1 : (unsigned)bottom / WATCH_TILE_SIZE;
+		for (unsigned ty = tileTop; ty <= tileBottom; ty++)
+			for (unsigned tx = tileLeft; tx <= tileRight; tx++)
+				dirty[ty * tilesX + tx] = 1;
+	}
+
+	const std::vector<unsigned>& lights = after.lights;
+
+	int count = 0;
+	for (unsigned ty = 0; ty < tilesY; ty++)
+	{
+		for (unsigned tx = 0; tx < tilesX; tx++)
+		{
+			char& tile = dirty[ty * tilesX + tx];
+			if (tile)
+			{
+				count++;
+				continue;
+			}
+
+			//primary hits of the tile in the old frame
+			bool secondary = false;
+			bool diffuse = false;
+			Vec3f low(INFINITY), high(-INFINITY);
+			for (unsigned y = ty * WATCH_TILE_SIZE; y < std::min(height, (ty + 1) * WATCH_TILE_SIZE) && !secondary; y++)
+			{
+				for (unsigned x = tx * WATCH_TILE_SIZE; x < std::min(width, (tx + 1) * WATCH_TILE_SIZE); x++)
+				{
+					Vec3f raydir = PrimaryRay(x, y);
+					float tnear = INFINITY;
+					unsigned hit = before.Size();
+					for (unsigned sphere = 0; sphere < before.Size(); sphere++)
+					{
+						float t0 = INFINITY, t1 = INFINITY;
+						if (before.Intersect(sphere, Vec3f(0), raydir, t0, t1))
+						{
+							if (t0 < 0) t0 = t1;
+							if (t0 < tnear)
+							{
+								tnear = t0;
+								hit = sphere;
+							}
+						}
+					}
+					if (hit == before.Size())
+						continue;
+					const Material& material = before.GetMaterial(hit);
+					if (material.transparency > 0 || material.reflection > 0)
+					{
+						secondary = true;
+						break;
+					}
+					Vec3f phit = raydir * tnear;
+					diffuse = true;
+					low = Vec3f(std::min(low.x, phit.x), std::min(low.y, phit.y), std::min(low.z, phit.z));
+					high = Vec3f(std::max(high.x, phit.x), std::max(high.y, phit.y), std::max(high.z, phit.z));
+				}
+			}
+
+			bool reached = secondary || (diffuse && lightChanged && !lights.empty());
+			if (diffuse && !reached)
+			{
+				//shadow rays are lines through a light's centre from somewhere in the ball around the hits, a
+				//changed sphere can only block one if it comes within its radius of that double cone
+				Vec3f middle = (low + high) * 0.5f;
+				float spread = (high - low).length() * 0.5f + 1e-3f;
+				for (size_t l = 0; l < lights.size() && !reached; l++)
+				{
+					Vec3f lightCenter = after.GetCenter(lights[l]);
+					Vec3f axis = lightCenter - middle;
+					float axisLength = axis.length();
+					if (axisLength <= spread)
+					{
+						reached = true;
+						break;
+					}
+					float coneAngle = asinf(spread / axisLength);
+					for (const CompactSphere& sphere : moved)
+					{
+						Vec3f offset = sphere.center - lightCenter;
+						float distance = offset.length();
+						float radius = sqrtf(sphere.radius2) + 1e-3f;
+						if (distance <= radius)
+						{
+							reached = true;
+							break;
+						}
+						float cosine = std::min(1.0f, fabsf(offset.dot(axis)) / (distance * axisLength));
+						if (acosf(cosine) <= coneAngle + asinf(radius / distance))
+						{
+							reached = true;
+							break;
+						}
+					}
+				}
+			}
+			if (reached)
+			{
+				tile = 1;
+				count++;
+			}
+		}
+	}
+	return count;
+}
+
+// Trace just the dirty tiles into a frame that already holds the rest, converting each pixel exactly as
+// TraceFrame would so patched frames match full renders
+void Raytracer::TraceTiles(const FrameSpheres& spheres, const std::vector<char>& dirty, FrameTarget& target)
+{
+	NoAllocRegion noAlloc("Render pixel loop");
+	unsigned tilesX = (width + WATCH_TILE_SIZE - 1) / WATCH_TILE_SIZE;
+	Vec3f row[WATCH_TILE_SIZE];
+	unsigned short half[WATCH_TILE_SIZE * 3];
+	for (size_t tile = 0; tile < dirty.size(); tile++)
+	{
+		if (!dirty[tile])
+			continue;
+		unsigned left = (unsigned)(tile % tilesX) * WATCH_TILE_SIZE;
+		unsigned top = (unsigned)(tile / tilesX) * WATCH_TILE_SIZE;
+		unsigned tileWidth = std::min(width - left, (unsigned)WATCH_TILE_SIZE);
+		for (unsigned y = top; y < std::min(height, top + WATCH_TILE_SIZE); y++)
+		{
+			for (unsigned i = 0; i < tileWidth; i++)
+				row[i] = TracePixel(left + i, y, spheres);
+			if (settings.halfFramebuffer)
+			{
+				HalfFloat::Pack(&row[0].x, half, tileWidth * 3);
+				HalfFloat::Unpack(half, &row[0].x, tileWidth * 3);
+			}
+			if (settings.outputFormat == OUTPUT_PFM)
+			{
+				// PFM rows run bottom to top
+				memcpy(target.pixels + ((size_t)(height - 1 - y) * width + left) * sizeof(Vec3f), row, tileWidth * sizeof(Vec3f));
+			}
+			else
+				PixelQuantizer::Quantize(&row[0].x, target.pixels + ((size_t)y * width + left) * 3, tileWidth * 3);
+		}
+	}
+}
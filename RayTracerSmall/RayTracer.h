@@ -1,14 +1,28 @@
 #pragma once
 
 #include "Global.h"
-#include "Sphere.h"
+#include "FrameSpheres.h"
 #include "Vec3.h"
 #include "JSONReader.h"
+#include "SceneFile.h"
+#include "SceneGenerator.h"
+#include "SceneWatcher.h"
 #include <string>
 #include <chrono>
 #include <mutex>
 #include <thread>
 #include "ThreadPool.h"
+#include "FrameWriter.h"
+#include "RenderSettings.h"
+#include "VideoPipe.h"
+#include "MappedFile.h"
+#include "PixelQuantizer.h"
+#include "HalfFloat.h"
+#include "JpegEncoder.h"
+#include "PngEncoder.h"
+#include "FrameArchive.h"
+#include "FrameCache.h"
+#include "AviWriter.h"
 
 using std::string;
 
@@ -22,38 +36,118 @@ using std::string;
 
 // This variable controls the maximum recursion depth
 #define MAX_RAY_DEPTH 5
+// Pixels traced before each quantize when quantizing at trace time
+#define RENDER_TILE_PIXELS 64
+// Width and height of the tiles watch mode decides to re-trace or keep
+#define WATCH_TILE_SIZE 16
+// Where watch mode keeps the frames it patches when no --cache was given
+#define WATCH_CACHE_DIRECTORY "framecache"
+
+// Where a frame's pixels are written while it's traced, set up by BeginFrame and sent on by EndFrame
+struct FrameTarget
+{
+	int iteration;
+	// rgb24 bytes, or bottom up rows of float rgb for OUTPUT_PFM
+	char* pixels;
+	size_t pixelBytes;
+	// frame writer buffer holding the pixels, or null when they're in the mapped file
+	FrameBuffer* buffer;
+	MappedFile mapped;
+	string fileName;
+};
 
 class Raytracer
 {
 public:
 	Raytracer(ThreadPool* threads);
 	Raytracer(const char* jsonpath, ThreadPool* threads);
+	Raytracer(const char* jsonpath, ThreadPool* threads, const RenderSettings& renderSettings);
+	//Renders a scene that's already loaded or generated, and deletes it with the raytracer
+	Raytracer(ReadSphere* scene, ThreadPool* threads, const RenderSettings& renderSettings);
+	//Sets up the outputs but renders nothing, give it a scene with SetJSON and then QueueFrames
+	Raytracer(ThreadPool* threads, const RenderSettings& renderSettings);
 	~Raytracer();
 	float mix(const float& a, const float& b, const float& mix);
-	Vec3f Trace(const Vec3f& rayorig, const Vec3f& raydir, const std::vector<Sphere>& spheres, const int& depth);
-	void Render(const std::vector<Sphere>& spheres, int iteration);
+	Vec3f Trace(const Vec3f& rayorig, const Vec3f& raydir, const FrameSpheres& spheres, const int& depth);
+	void Render(int iteration);
+	void RenderFrame(const FrameSpheres& spheres, FrameTarget& target);
+	void TraceFrame(const FrameSpheres& spheres, FrameTarget& target);
+	Vec3f TracePixel(unsigned x, unsigned y, const FrameSpheres& spheres);
+	Vec3f PrimaryRay(unsigned x, unsigned y);
+	void QuantizePixels(const Vec3f* image, char* out);
+	void OutputHalfPixels(const unsigned short* image, FrameTarget& target);
 	void BasicRender();
 	void SimpleShrinking();
 	void SmoothScaling(int r);
 	void SmoothScalingThreaded();
+	const FrameSpheres& EvaluateFrame(int iteration);
 	void JSONRender(int iteration);
 	void JSONRenderThreaded();
+	//JSONRenderThreaded in two halves: queue every frame in the range and return straight away, then wait for
+	//this raytracer's frames alone (not the whole pool) and close its outputs
+	void QueueFrames();
+	void FinishFrames();
+	void Watch();
 
 	ReadSphere* GetJSON() { return json; }
+	const RenderSettings& GetSettings() { return settings; }
 	void SetJSON(ReadSphere* j) { json = j; }
+
+	//Bytes the Framebuffer arena reserves for rendering with settings on a pool of workers
+	static size_t FramebufferArenaBytes(const RenderSettings& settings, int workers);
 private:
+	void Init(ThreadPool* threads, const RenderSettings& renderSettings);
+	void ReleasePoolLock();
+	void FrameDone();
+	string FramePath(int iteration, const char* extension);
+	void GetFrameRange(int& first, int& last);
+	void BeginFrame(int iteration, FrameTarget& target);
+	void RenderChanges(const ReadSphere* previous, int iteration);
+	int FindDirtyTiles(const FrameSpheres& before, const FrameSpheres& after, const std::vector<int>& changed, std::vector<char>& dirty);
+	void TraceTiles(const FrameSpheres& spheres, const std::vector<char>& dirty, FrameTarget& target);
+	void EndFrame(FrameTarget& target);
+	void WriteMjpegFrame(FrameBuffer* rgb, int iteration);
+	void WritePNG(FrameBuffer* rgb, const string& fileName);
+
 	ReadSphere* json;
 
-	// debug width/height: 640x480
-	// release width/height: 1920x1080
-	unsigned width = 640;
-	unsigned height = 480;
-	unsigned size = width * height;
+	RenderSettings settings;
+	unsigned width;
+	unsigned height;
+	unsigned size;
 	float invWidth;
 	float invHeight;
-	float fov = 30;
+	float fov;
 	float aspectratio;
 	float angle;
 
 	ThreadPool* threadPool;
+	//frame buffers and anything else allocated while rendering a frame
+	Heap* renderHeap;
+	//mapped (huge page backed where possible) heap the per-frame image buffers come from
+	Heap* framebufferHeap;
+	//writes finished frames off the render threads
+	FrameWriter* frameWriter;
+	//single ffmpeg process frames are streamed to, only open for OUTPUT_VIDEO_PIPE
+	VideoPipe* videoPipe;
+	//in process encoder and container for OUTPUT_MJPEG
+	JpegEncoder* jpegEncoder;
+	AviWriter* aviWriter;
+	//lossless encoder for OUTPUT_PNG
+	PngEncoder* pngEncoder;
+	//single file every frame goes into for OUTPUT_ARCHIVE
+	FrameArchiveWriter* frameArchive;
+	//finished frames from earlier runs, null unless a cache directory was given
+	FrameCache* frameCache;
+	//frames queued by JSONRender and not yet output, FinishFrames waits for it to reach 0
+	std::atomic<int> framesQueued{ 0 };
+	std::mutex framesMutex;
+	std::condition_variable framesDone;
+	//time spent outputting this raytracer's frames, for the running average each frame reports
+	std::atomic<long long> outputTime{ 0 };
+	std::atomic<int> framesOutput{ 0 };
+	//what the last scene edit cost, counted by RenderChanges
+	std::atomic<int> watchFramesChanged{ 0 };
+	std::atomic<int> watchTilesTraced{ 0 };
+	std::atomic<int> watchTilesTotal{ 0 };
 };
\ No newline at end of file
@@ -0,0 +1,186 @@
+#include "RenderSettings.h"
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+
+//Returns the value part of arg if it starts with name, otherwise null
+static const char* ArgValue(const char* arg, const char* name)
+{
+	size_t length = strlen(name);
+	if (strncmp(arg, name, length) != 0)
+		return nullptr;
+	return arg + length;
+}
+
+//Reads a whole positive image dimension, small enough that width * height * 3 can't overflow
+static bool ParseDimension(const char* value, unsigned& dimension)
+{
+	char* end;
+	long parsed = strtol(value, &end, 10);
+	if (end == value || *end != '\0' || parsed <= 0 || parsed > 32768)
+		return false;
+	dimension = (unsigned)parsed;
+	return true;
+}
+
+bool RenderSettings::ParseArg(const char* arg)
+{
+	const char* value;
+	if ((value = ArgValue(arg, "--width=")) != nullptr)
+	{
+		return ParseDimension(value, width);
+	}
+	if ((value = ArgValue(arg, "--height=")) != nullptr)
+	{
+		return ParseDimension(value, height);
+	}
+	if ((value = ArgValue(arg, "--fov=")) != nullptr)
+	{
+		fov = (float)atof(value);
+		return fov > 0;
+	}
+	if ((value = ArgValue(arg, "--output=")) != nullptr)
+	{
+		if (strcmp(value, "ppm") == 0)
+			outputFormat = OUTPUT_PPM;
+		else if (strcmp(value, "mapped") == 0)
+			outputFormat = OUTPUT_PPM_MAPPED;
+		else if (strcmp(value, "video") == 0)
+			outputFormat = OUTPUT_VIDEO_PIPE;
+		else if (strcmp(value, "mjpeg") == 0)
+			outputFormat = OUTPUT_MJPEG;
+		else if (strcmp(value, "png") == 0)
+			outputFormat = OUTPUT_PNG;
+		else if (strcmp(value, "archive") == 0)
+			outputFormat = OUTPUT_ARCHIVE;
+		else if (strcmp(value, "delta") == 0)
+			outputFormat = OUTPUT_DELTA;
+		else if (strcmp(value, "pfm") == 0)
+			outputFormat = OUTPUT_PFM;
+		else
+			return false;
+		return true;
+	}
+	if ((value = ArgValue(arg, "--framebuffer=")) != nullptr)
+	{
+		if (strcmp(value, "float") == 0)
+			halfFramebuffer = false;
+		else if (strcmp(value, "half") == 0)
+			halfFramebuffer = true;
+		else
+			return false;
+		return true;
+	}
+	if ((value = ArgValue(arg, "--scene=")) != nullptr)
+	{
+		scenePath = value;
+		return *value != '\0';
+	}
+	if ((value = ArgValue(arg, "--generate=")) != nullptr)
+	{
+		generateSpec = value;
+		return *value != '\0';
+	}
+	if ((value = ArgValue(arg, "--export=")) != nullptr)
+	{
+		exportPath = value;
+		return *value != '\0';
+	}
+	if ((value = ArgValue(arg, "--compile=")) != nullptr)
+	{
+		compilePath = value;
+		return *value != '\0';
+	}
+	if ((value = ArgValue(arg, "--frames=")) != nullptr)
+	{
+		//FIRST-LAST, FIRST- or a single frame
+		char* end;
+		firstFrame = (int)strtol(value, &end, 10);
+		if (end == value || firstFrame < 0)
+			return false;
+		if (*end == '\0')
+		{
+			lastFrame = firstFrame;
+			return true;
+		}
+		if (*end != '-')
+			return false;
+		if (end[1] == '\0')
+		{
+			lastFrame = -1;
+			return true;
+		}
+		const char* last = end + 1;
+		lastFrame = (int)strtol(last, &end, 10);
+		return end != last && *end == '\0' && lastFrame >= firstFrame;
+	}
+	if (strcmp(arg, "--watch") == 0)
+	{
+		watch = true;
+		return true;
+	}
+	if ((value = ArgValue(arg, "--cache=")) != nullptr)
+	{
+		cacheDirectory = value;
+		return *value != '\0';
+	}
+	if ((value = ArgValue(arg, "--extract=")) != nullptr)
+	{
+		extractPath = value;
+		return *value != '\0';
+	}
+	if ((value = ArgValue(arg, "--frame=")) != nullptr)
+	{
+		char* end;
+		extractFrame = (int)strtol(value, &end, 10);
+		return end != value && *end == '\0' && extractFrame >= 0;
+	}
+	if ((value = ArgValue(arg, "--outdir=")) != nullptr)
+	{
+		outputDirectory = value;
+		return *value != '\0';
+	}
+	if ((value = ArgValue(arg, "--jobs=")) != nullptr)
+	{
+		jobsPath = value;
+		return *value != '\0';
+	}
+	if ((value = ArgValue(arg, "--quantize=")) != nullptr)
+	{
+		if (strcmp(value, "deferred") == 0)
+			fusedQuantize = false;
+		else if (strcmp(value, "fused") == 0)
+			fusedQuantize = true;
+		else
+			return false;
+		return true;
+	}
+	return false;
+}
+
+void RenderSettings::PrintUsage()
+{
+	std::cout << "Options:\n"
+		"\t--scene=PATH\t\tJSON or compiled scene to render (default SphereJSON.json)\n"
+		"\t--generate=SETTINGS\t\tbuild a seeded random scene instead of loading one, e.g. count=100000,lights=4\n"
+		"\t\t\t\t(--generate=help lists the settings)\n"
+		"\t--compile=PATH\t\tcompile the scene to a binary file that loads with no parsing, then exit\n"
+		"\t--export=PATH\t\twrite the scene out as JSON, then exit\n"
+		"\t--width=N --height=N\tframe size (default 640x480)\n"
+		"\t--fov=DEGREES\t\tfield of view (default 30)\n"
+		"\t--output=ppm|mapped|png|archive|delta|pfm|video|mjpeg\tframe output: async PPM writes, PPMs quantized into an mmap of the file,\n"
+		"\t\t\t\tlossless PNGs about a tenth the size of the PPMs, every frame in one indexed output.rtfa,\n"
+		"\t\t\t\tthe same archive storing only changed tiles between keyframes, unclamped HDR PFMs,\n"
+		"\t\t\t\tframes piped straight into ffmpeg to make output.mp4,\n"
+		"\t\t\t\tor frames JPEG encoded in process into output.avi\n"
+		"\t--quantize=deferred|fused\tquantize a float framebuffer after tracing, or each tile as it's traced\n"
+		"\t\t\t\twith no float framebuffer at all\n"
+		"\t--framebuffer=float|half\tstore the traced frame as Vec3f or as half floats\n"
+		"\t--frames=FIRST-LAST\t\trender only part of the animation, FIRST- runs to the end (default all)\n"
+		"\t--watch\t\t\tkeep running and re-render the frames and tiles each edit to the scene file changes\n"
+		"\t--cache=DIRECTORY\t\treuse frames from earlier runs with the same spheres and settings\n"
+		"\t--outdir=DIRECTORY\t\twhere frames are written (default output), animation files are named after it\n"
+		"\t--jobs=FILE\t\trender every scene in FILE, one a line with any of these settings after it,\n"
+		"\t\t\t\teach into its own directory under --outdir\n"
+		"\t--extract=ARCHIVE [--frame=N]\twrite the frames of an archive, or just frame N, to output/spheresN.ppm\n";
+}
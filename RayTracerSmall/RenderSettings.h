@@ -0,0 +1,54 @@
+#pragma once
+
+//How each finished frame leaves the renderer
+enum OutputFormat
+{
+	OUTPUT_PPM,			//P6 files written by the FrameWriter I/O thread
+	OUTPUT_PPM_MAPPED,	//P6 files quantized straight into an mmap of the output file
+	OUTPUT_VIDEO_PIPE,	//raw frames streamed to one ffmpeg process, falls back to OUTPUT_PPM without ffmpeg
+	OUTPUT_MJPEG,		//frames JPEG encoded in process and written to a Motion JPEG AVI, no ffmpeg needed
+	OUTPUT_PNG,			//lossless PNG files, strips compressed in parallel then written by the FrameWriter
+	OUTPUT_ARCHIVE,		//every frame appended to one indexed archive file, read back with --extract
+	OUTPUT_DELTA,		//archive where frames between keyframes only store the tiles that changed
+	OUTPUT_PFM			//unclamped HDR colour as float PFM files, for tone mapping without a re-render
+};
+
+//Everything about a render that can be chosen from the command line
+struct RenderSettings
+{
+	// debug width/height: 640x480
+	// release width/height: 1920x1080
+	unsigned width = 640;
+	unsigned height = 480;
+	float fov = 30;
+	OutputFormat outputFormat = OUTPUT_PPM;
+	//clamp and quantize each tile to bytes as soon as it's traced instead of keeping a float framebuffer
+	bool fusedQuantize = false;
+	//keep the traced frame as half floats rather than Vec3f, half the memory for the HDR image
+	bool halfFramebuffer = false;
+	//JSON or compiled scene to render
+	const char* scenePath = "SphereJSON.json";
+	//when set, a scene is generated from these settings instead of loading scenePath
+	const char* generateSpec = nullptr;
+	//when set, the scene is compiled to this file, or written out as JSON to exportPath, instead of rendered
+	const char* compilePath = nullptr;
+	const char* exportPath = nullptr;
+	//range of frames rendered, lastFrame -1 runs to the end of the animation
+	int firstFrame = 0;
+	int lastFrame = -1;
+	//after rendering, keep watching scenePath and re-render only what each edit changes
+	bool watch = false;
+	//directory finished frames are cached in and reused from on later runs, null for no cache
+	const char* cacheDirectory = nullptr;
+	//when set, frames are pulled out of this archive as PPMs instead of rendering, all of them or just extractFrame
+	const char* extractPath = nullptr;
+	int extractFrame = -1;
+	//directory frame files are written to, and the name animation files (OUTPUT_VIDEO_PIPE and the like) take
+	const char* outputDirectory = "output";
+	//when set, every scene listed in this file is rendered through the one pool instead of scenePath
+	const char* jobsPath = nullptr;
+
+	//Applies a single --name=value argument, returns false if it isn't recognised
+	bool ParseArg(const char* arg);
+	static void PrintUsage();
+};
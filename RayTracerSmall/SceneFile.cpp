@@ -0,0 +1,188 @@
+#include "SceneFile.h"
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+
+//Size in bytes of one element of each array, in header order
+static const size_t s_elementBytes[SCENE_FILE_ARRAYS] =
+{
+	sizeof(Sphere), sizeof(Vec3f), sizeof(Vec3f), sizeof(Vec3f), sizeof(Vec3f), sizeof(float), sizeof(float), sizeof(unsigned),
+	sizeof(float), sizeof(float), sizeof(float), sizeof(float), sizeof(float), sizeof(float), sizeof(float),
+	sizeof(Material), sizeof(Vec3f), sizeof(KeyTrack), sizeof(Keyframe)
+};
+
+//Entries in array i of a scene with the counts in header
+static unsigned long long ArrayLength(int i, const SceneFileHeader& header)
+{
+	if (i < SCENE_FILE_SPHERE_ARRAYS)
+		return (unsigned long long)header.sphereAmount;
+	if (i < SCENE_FILE_ARRAYS - 2)
+		return (unsigned long long)header.materialAmount;
+	return (unsigned long long)(i == SCENE_FILE_ARRAYS - 2 ? header.trackAmount : header.keyAmount);
+}
+
+static bool IsSceneFile(const char* path)
+{
+	char magic[4];
+	FILE* file = fopen(path, "rb");
+	if (file == nullptr)
+		return false;
+	bool compiled = fread(magic, 1, 4, file) == 4 && memcmp(magic, "RTSC", 4) == 0;
+	fclose(file);
+	return compiled;
+}
+
+bool SceneFile::Write(const ReadSphere* scene, const char* path)
+{
+	const void* arrays[SCENE_FILE_ARRAYS] =
+	{
+		scene->spheres, scene->endPos, scene->movement, scene->endColours, scene->colourChange, scene->endRad, scene->radChange,
+		scene->sphereMaterial, scene->startX, scene->startY, scene->startZ, scene->moveX, scene->moveY, scene->moveZ, scene->startRadius,
+		scene->materials, scene->materialColourChange, scene->tracks, scene->keys
+	};
+
+	SceneFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "RTSC", 4);
+	header.version = SCENE_FILE_VERSION;
+	header.sphereBytes = sizeof(Sphere);
+	header.sphereAmount = scene->sphereAmount;
+	header.frameCount = scene->frameCount;
+	header.materialAmount = scene->materialAmount;
+	header.trackAmount = scene->trackAmount;
+	header.keyAmount = scene->keyAmount;
+	unsigned long long offset = sizeof(header);
+	for (int i = 0; i < SCENE_FILE_ARRAYS; i++)
+	{
+		offset = (offset + SCENE_FILE_ALIGN - 1) & ~(unsigned long long)(SCENE_FILE_ALIGN - 1);
+		header.offsets[i] = offset;
+		offset += s_elementBytes[i] * ArrayLength(i, header);
+	}
+
+	//written alongside and renamed over path, so a process with the old file mapped (a render watching it) keeps
+	//reading the old scene instead of seeing it change or shrink under it
+	std::string temporary = std::string(path) + ".tmp";
+	FILE* file = fopen(temporary.c_str(), "wb");
+	if (file == nullptr)
+	{
+		std::cout << "Unable to create scene file: " << temporary << std::endl;
+		return false;
+	}
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+	static const char padding[SCENE_FILE_ALIGN] = {};
+	long position = sizeof(header);
+	for (int i = 0; i < SCENE_FILE_ARRAYS && written; i++)
+	{
+		size_t gap = (size_t)(header.offsets[i] - position);
+		size_t bytes = (size_t)(s_elementBytes[i] * ArrayLength(i, header));
+		written = fwrite(padding, 1, gap, file) == gap && fwrite(arrays[i], 1, bytes, file) == bytes;
+		position = (long)(header.offsets[i] + bytes);
+	}
+	written = fclose(file) == 0 && written;
+#ifdef _WIN32
+	//rename won't replace an existing file on Windows
+	if (written)
+		remove(path);
+#endif
+	if (!written || rename(temporary.c_str(), path) != 0)
+	{
+		std::cout << "Failed writing scene file: " << path << std::endl;
+		remove(temporary.c_str());
+		return false;
+	}
+	return true;
+}
+
+ReadSphere* SceneFile::Load(const char* path)
+{
+	MappedFile* file = new MappedFile();
+	if (!file->OpenRead(path) || file->GetSize() < sizeof(SceneFileHeader))
+	{
+		std::cout << "Unable to load scene file: " << path << std::endl;
+		delete file;
+		return nullptr;
+	}
+
+	const SceneFileHeader* header = (const SceneFileHeader*)file->GetData();
+	bool valid = memcmp(header->magic, "RTSC", 4) == 0 && header->version == SCENE_FILE_VERSION &&
+		header->sphereBytes == sizeof(Sphere) && header->sphereAmount >= 0 && header->frameCount > 0 &&
+		header->materialAmount >= 0 && header->materialAmount <= header->sphereAmount && header->trackAmount >= 0 && header->keyAmount >= 0;
+	for (int i = 0; i < SCENE_FILE_ARRAYS && valid; i++)
+	{
+		unsigned long long end = header->offsets[i] + s_elementBytes[i] * ArrayLength(i, *header);
+		valid = header->offsets[i] % SCENE_FILE_ALIGN == 0 && header->offsets[i] >= sizeof(SceneFileHeader) && end <= file->GetSize();
+	}
+	if (!valid)
+	{
+		std::stringstream msg;
+		msg << "Scene file " << path << " is damaged or was compiled by an incompatible build (version " << header->version << ")\n";
+		std::cout << msg.str();
+		delete file;
+		return nullptr;
+	}
+
+	char* data = file->GetData();
+	ReadSphere* scene = new ReadSphere(header->sphereAmount, header->frameCount, file);
+	scene->spheres = (Sphere*)(data + header->offsets[0]);
+	scene->endPos = (Vec3f*)(data + header->offsets[1]);
+	scene->movement = (Vec3f*)(data + header->offsets[2]);
+	scene->endColours = (Vec3f*)(data + header->offsets[3]);
+	scene->colourChange = (Vec3f*)(data + header->offsets[4]);
+	scene->endRad = (float*)(data + header->offsets[5]);
+	scene->radChange = (float*)(data + header->offsets[6]);
+	scene->sphereMaterial = (unsigned*)(data + header->offsets[7]);
+	scene->startX = (float*)(data + header->offsets[8]);
+	scene->startY = (float*)(data + header->offsets[9]);
+	scene->startZ = (float*)(data + header->offsets[10]);
+	scene->moveX = (float*)(data + header->offsets[11]);
+	scene->moveY = (float*)(data + header->offsets[12]);
+	scene->moveZ = (float*)(data + header->offsets[13]);
+	scene->startRadius = (float*)(data + header->offsets[14]);
+	scene->materials = (Material*)(data + header->offsets[15]);
+	scene->materialColourChange = (Vec3f*)(data + header->offsets[16]);
+	scene->materialAmount = header->materialAmount;
+	scene->tracks = (KeyTrack*)(data + header->offsets[17]);
+	scene->trackAmount = header->trackAmount;
+	scene->keys = (Keyframe*)(data + header->offsets[18]);
+	scene->keyAmount = header->keyAmount;
+	for (int i = 0; i < scene->sphereAmount; i++)
+	{
+		//an index past the table would be read while rendering, so check them once here
+		if (scene->sphereMaterial[i] >= (unsigned)scene->materialAmount)
+		{
+			std::cout << "Scene file " << path << " has a sphere with no material" << std::endl;
+			delete scene;
+			return nullptr;
+		}
+	}
+	//a colour track writes its sphere's material every frame, so that material can't be shared with another sphere
+	std::vector<int> materialUsers(scene->materialAmount, 0);
+	for (int i = 0; i < scene->sphereAmount; i++)
+		materialUsers[scene->sphereMaterial[i]]++;
+	//the same for the tracks, which also have to be in sphere order with their keys in frame order
+	for (int t = 0; t < scene->trackAmount; t++)
+	{
+		const KeyTrack& track = scene->tracks[t];
+		bool validTrack = track.sphere < (unsigned)scene->sphereAmount && track.property < TRACK_PROPERTY_COUNT && track.count > 0 &&
+			track.first <= (unsigned)scene->keyAmount && track.count <= (unsigned)scene->keyAmount - track.first &&
+			(t == 0 || scene->tracks[t - 1].sphere <= track.sphere) &&
+			(track.property != TRACK_COLOUR || materialUsers[scene->sphereMaterial[track.sphere]] == 1);
+		for (unsigned k = 1; k < track.count && validTrack; k++)
+			validTrack = scene->keys[track.first + k].frame > scene->keys[track.first + k - 1].frame;
+		if (!validTrack)
+		{
+			std::cout << "Scene file " << path << " has a damaged keyframe track" << std::endl;
+			delete scene;
+			return nullptr;
+		}
+	}
+	scene->BuildAnimation();
+	return scene;
+}
+
+ReadSphere* SceneFile::LoadScene(const char* path)
+{
+	if (IsSceneFile(path))
+		return Load(path);
+	return JSONReader::LoadJSON(path);
+}
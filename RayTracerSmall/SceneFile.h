@@ -0,0 +1,42 @@
+#pragma once
+
+#include "JSONReader.h"
+#include "MappedFile.h"
+
+//Bump whenever the header or the array layout changes, older files are then rejected rather than misread
+#define SCENE_FILE_VERSION 4
+//Every array starts on a cache line so it can be used straight out of the mapping
+#define SCENE_FILE_ALIGN 64
+//spheres, endPos, movement, endColours, colourChange, endRad, radChange, sphereMaterial and the seven arrays a
+//frame is evaluated from, one entry per sphere, then materials and materialColourChange, one per material, then
+//the keyframe tracks and their keys
+#define SCENE_FILE_ARRAYS 19
+#define SCENE_FILE_SPHERE_ARRAYS 15
+
+//Start of a compiled scene, followed by ReadSphere's arrays each at its offset
+struct SceneFileHeader
+{
+	char magic[4];			//"RTSC"
+	unsigned version;
+	unsigned sphereBytes;	//sizeof(Sphere) of the build that wrote it
+	int sphereAmount;
+	int frameCount;
+	int materialAmount;
+	int trackAmount;
+	int keyAmount;
+	unsigned long long offsets[SCENE_FILE_ARRAYS];
+};
+
+//Compiled binary scenes: ReadSphere's arrays, movement and materials already worked out, written as they sit in memory.
+//Loading maps the file and points the ReadSphere at it, so there's no parsing and no copying.
+class SceneFile
+{
+public:
+	//Writes scene to path in the compiled format. The file is replaced rather than rewritten, as anything that
+	//edits a compiled scene must, since a loaded scene reads straight from its mapping.
+	static bool Write(const ReadSphere* scene, const char* path);
+	//Maps a compiled scene, null if path isn't one or was written by an incompatible build
+	static ReadSphere* Load(const char* path);
+	//Loads path as a compiled scene when it is one, otherwise parses it as JSON
+	static ReadSphere* LoadScene(const char* path);
+};
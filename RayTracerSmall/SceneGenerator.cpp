@@ -0,0 +1,258 @@
+#include "SceneGenerator.h"
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+//Spheres sit between these distances in front of the camera, which looks down -z
+#define GENERATOR_NEAR 30.0f
+#define GENERATOR_FAR 130.0f
+//Half the view's width and height per unit of depth, a little wider than the default 30 degree 4:3 view
+#define GENERATOR_SPREAD_X 0.36f
+#define GENERATOR_SPREAD_Y 0.27f
+//Number of clumps for DISTRIBUTION_CLUSTERED and how far they spread
+#define GENERATOR_CLUSTERS 8
+#define GENERATOR_CLUSTER_SIGMA 8.0f
+
+//SplitMix64, small and fully specified, unlike rand() and the <random> distributions
+class GeneratorRandom
+{
+public:
+	GeneratorRandom(unsigned long long seed) : m_state(seed) {}
+
+	unsigned long long Next()
+	{
+		unsigned long long z = (m_state += 0x9E3779B97F4A7C15ull);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		return z ^ (z >> 31);
+	}
+
+	//[0, 1) with 24 bits, exact in a float
+	float Unit() { return (float)(Next() >> 40) * (1.0f / 16777216.0f); }
+	float Range(float low, float high) { return low + (high - low) * Unit(); }
+
+	//Standard normal by Box-Muller
+	float Gaussian()
+	{
+		float u = 1.0f - Unit();
+		float v = Unit();
+		return sqrtf(-2.0f * logf(u)) * cosf(6.2831853f * v);
+	}
+
+private:
+	unsigned long long m_state;
+};
+
+//Point depth units in front of the camera, u and v (0-1) across and up the region spheres go in
+static Vec3f ViewPoint(float u, float v, float depth)
+{
+	return Vec3f((2 * u - 1) * GENERATOR_SPREAD_X * depth, (2 * v - 1) * GENERATOR_SPREAD_Y * depth, -depth);
+}
+
+//Depth with the density even through the volume, which widens with distance
+static float UniformDepth(GeneratorRandom& random)
+{
+	float nearCubed = GENERATOR_NEAR * GENERATOR_NEAR * GENERATOR_NEAR;
+	float farCubed = GENERATOR_FAR * GENERATOR_FAR * GENERATOR_FAR;
+	return cbrtf(nearCubed + random.Unit() * (farCubed - nearCubed));
+}
+
+static bool ParseDistribution(const char* value, SceneDistribution& distribution)
+{
+	if (strcmp(value, "uniform") == 0)
+		distribution = DISTRIBUTION_UNIFORM;
+	else if (strcmp(value, "clustered") == 0)
+		distribution = DISTRIBUTION_CLUSTERED;
+	else if (strcmp(value, "grid") == 0)
+		distribution = DISTRIBUTION_GRID;
+	else
+		return false;
+	return true;
+}
+
+static bool ParseAnimation(const char* value, SceneAnimation& animation)
+{
+	if (strcmp(value, "static") == 0)
+		animation = ANIMATION_STATIC;
+	else if (strcmp(value, "drift") == 0)
+		animation = ANIMATION_DRIFT;
+	else if (strcmp(value, "full") == 0)
+		animation = ANIMATION_FULL;
+	else
+		return false;
+	return true;
+}
+
+bool GeneratorSettings::Parse(const char* spec)
+{
+	std::stringstream items(spec);
+	std::string item;
+	while (std::getline(items, item, ','))
+	{
+		size_t equals = item.find('=');
+		std::string name = equals == std::string::npos ? "count" : item.substr(0, equals);
+		std::string value = equals == std::string::npos ? item : item.substr(equals + 1);
+		const char* text = value.c_str();
+		bool valid = true;
+		if (name == "count")
+			valid = (sphereCount = atoi(text)) > 0;
+		else if (name == "lights")
+			valid = (lightCount = atoi(text)) >= 0;
+		else if (name == "frames")
+			valid = (frameCount = atoi(text)) > 0;
+		else if (name == "seed")
+			seed = strtoull(text, nullptr, 10);
+		else if (name == "distribution")
+			valid = ParseDistribution(text, distribution);
+		else if (name == "animation")
+			valid = ParseAnimation(text, animation);
+		else if (name == "materials")
+		{
+			//DIFFUSE:REFLECTIVE:GLASS weights
+			valid = sscanf(text, "%f:%f:%f", &diffuseWeight, &reflectiveWeight, &glassWeight) == 3 &&
+				diffuseWeight >= 0 && reflectiveWeight >= 0 && glassWeight >= 0 && diffuseWeight + reflectiveWeight + glassWeight > 0;
+		}
+		else
+			valid = false;
+
+		if (!valid)
+		{
+			std::cout << "Scene generator doesn't understand '" << item << "'" << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+ReadSphere* SceneGenerator::Generate(const GeneratorSettings& generator)
+{
+	HeapScope heapScope("JSON");
+	GeneratorRandom random(generator.seed);
+	int count = generator.sphereCount + generator.lightCount;
+	ReadSphere* scene = new ReadSphere(count, generator.frameCount);
+
+	//radius from the average spacing, so a scene of any size fills the view about as densely
+	float nearCubed = GENERATOR_NEAR * GENERATOR_NEAR * GENERATOR_NEAR;
+	float farCubed = GENERATOR_FAR * GENERATOR_FAR * GENERATOR_FAR;
+	float volume = 4 * GENERATOR_SPREAD_X * GENERATOR_SPREAD_Y * (farCubed - nearCubed) / 3;
+	float spacing = cbrtf(volume / generator.sphereCount);
+	float radius = std::min(std::max(spacing * 0.3f, 0.05f), 8.0f);
+	int gridSide = (int)ceil(cbrt((double)generator.sphereCount));
+
+	Vec3f clusters[GENERATOR_CLUSTERS];
+	for (int i = 0; i < GENERATOR_CLUSTERS; i++)
+		clusters[i] = ViewPoint(random.Range(0.15f, 0.85f), random.Range(0.15f, 0.85f), UniformDepth(random));
+
+	float totalWeight = generator.diffuseWeight + generator.reflectiveWeight + generator.glassWeight;
+	for (int i = 0; i < generator.sphereCount; i++)
+	{
+		Sphere& sphere = scene->spheres[i];
+		float size = radius;
+		switch (generator.distribution)
+		{
+		case DISTRIBUTION_UNIFORM:
+			sphere.center = ViewPoint(random.Unit(), random.Unit(), UniformDepth(random));
+			break;
+		case DISTRIBUTION_CLUSTERED:
+		{
+			const Vec3f& cluster = clusters[random.Next() % GENERATOR_CLUSTERS];
+			sphere.center = cluster + Vec3f(random.Gaussian(), random.Gaussian(), random.Gaussian()) * GENERATOR_CLUSTER_SIGMA;
+			break;
+		}
+		case DISTRIBUTION_GRID:
+		{
+			float u = (i % gridSide + 0.5f) / gridSide;
+			float v = (i / gridSide % gridSide + 0.5f) / gridSide;
+			float w = (i / gridSide / gridSide + 0.5f) / gridSide;
+			float depth = GENERATOR_NEAR + w * (GENERATOR_FAR - GENERATOR_NEAR);
+			sphere.center = ViewPoint(u, v, depth);
+			//cells are narrower close to the camera, keep each sphere inside its own
+			float cell = std::min(2 * GENERATOR_SPREAD_Y * depth, GENERATOR_FAR - GENERATOR_NEAR) / gridSide;
+			size = std::min(size, cell * 0.3f);
+			break;
+		}
+		}
+		sphere.radius = size * random.Range(0.5f, 1.5f);
+		sphere.radius2 = sphere.radius * sphere.radius;
+		sphere.surfaceColor = Vec3f(random.Range(0.1f, 1), random.Range(0.1f, 1), random.Range(0.1f, 1));
+		sphere.emissionColor = Vec3f(0);
+
+		float material = random.Unit() * totalWeight;
+		if (material < generator.diffuseWeight)
+		{
+			sphere.reflection = 0;
+			sphere.transparency = 0;
+		}
+		else if (material < generator.diffuseWeight + generator.reflectiveWeight)
+		{
+			sphere.reflection = random.Range(0.3f, 1);
+			sphere.transparency = 0;
+		}
+		else
+		{
+			sphere.reflection = random.Range(0.5f, 1);
+			sphere.transparency = random.Range(0.5f, 1);
+		}
+
+		scene->endPos[i] = sphere.center;
+		scene->endRad[i] = sphere.radius;
+		scene->endColours[i] = sphere.surfaceColor;
+		if (generator.animation != ANIMATION_STATIC)
+		{
+			float reach = spacing * 2;
+			scene->endPos[i] += Vec3f(random.Range(-reach, reach), random.Range(-reach, reach), random.Range(-reach, reach));
+		}
+		if (generator.animation == ANIMATION_FULL)
+		{
+			scene->endRad[i] = sphere.radius * random.Range(0.5f, 1.5f);
+			scene->endColours[i] = Vec3f(random.Range(0.1f, 1), random.Range(0.1f, 1), random.Range(0.1f, 1));
+		}
+	}
+
+	//lights above and behind the camera, dimmer the more there are so the scene keeps its brightness
+	for (int i = generator.sphereCount; i < count; i++)
+	{
+		Sphere& light = scene->spheres[i];
+		light.center = Vec3f(random.Range(-60, 60), random.Range(40, 80), random.Range(-40, 10));
+		light.radius = 3;
+		light.radius2 = 9;
+		light.surfaceColor = Vec3f(0);
+		light.emissionColor = Vec3f(random.Range(0.8f, 1), random.Range(0.8f, 1), random.Range(0.8f, 1)) * (3.0f / generator.lightCount);
+		light.reflection = 0;
+		light.transparency = 0;
+		scene->endPos[i] = light.center;
+		scene->endRad[i] = light.radius;
+		scene->endColours[i] = light.surfaceColor;
+	}
+
+	scene->CalcMovement();
+	scene->CalcColourChange();
+	scene->CalcRadiusChange();
+	scene->BuildMaterials();
+	scene->BuildAnimation();
+	return scene;
+}
+
+ReadSphere* SceneGenerator::Generate(const char* spec)
+{
+	GeneratorSettings generator;
+	if (!generator.Parse(spec))
+	{
+		PrintUsage();
+		return nullptr;
+	}
+	return Generate(generator);
+}
+
+void SceneGenerator::PrintUsage()
+{
+	std::cout << "Scene generator settings, comma separated:\n"
+		"\tcount=N\t\t\tspheres, not counting lights (default 1000, a bare number sets this)\n"
+		"\tlights=N\t\tlight spheres (default 1)\n"
+		"\tframes=N\t\tanimation length (default 100)\n"
+		"\tseed=N\t\t\tthe same seed always gives the same scene (default 1)\n"
+		"\tdistribution=uniform|clustered|grid\n"
+		"\tanimation=static|drift|full\tnothing moves, spheres move, or they also resize and change colour\n"
+		"\tmaterials=D:R:G\t\trelative amounts of diffuse, reflective and glass spheres (default 6:3:1)\n";
+}
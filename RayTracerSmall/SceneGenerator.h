@@ -0,0 +1,48 @@
+#pragma once
+
+#include "JSONReader.h"
+
+//How generated spheres are spread through the camera's view
+enum SceneDistribution
+{
+	DISTRIBUTION_UNIFORM,	//evenly through the volume in front of the camera
+	DISTRIBUTION_CLUSTERED,	//gaussian clumps around a handful of centres
+	DISTRIBUTION_GRID		//a regular lattice
+};
+
+//How generated spheres change over the animation
+enum SceneAnimation
+{
+	ANIMATION_STATIC,		//nothing moves, every frame is the same
+	ANIMATION_DRIFT,		//spheres move a short way
+	ANIMATION_FULL			//spheres move, grow or shrink and change colour
+};
+
+//Everything that decides a generated scene, the same settings and seed always give the same spheres
+struct GeneratorSettings
+{
+	int sphereCount = 1000;
+	int lightCount = 1;
+	int frameCount = 100;
+	unsigned long long seed = 1;
+	SceneDistribution distribution = DISTRIBUTION_UNIFORM;
+	SceneAnimation animation = ANIMATION_DRIFT;
+	//relative weights of diffuse, reflective and glass spheres
+	float diffuseWeight = 6;
+	float reflectiveWeight = 3;
+	float glassWeight = 1;
+
+	//Reads a comma separated list of name=value pairs, or just a sphere count, false if any part isn't understood
+	bool Parse(const char* spec);
+};
+
+//Builds scenes of any size for benchmarking, straight into a ReadSphere. SaveJSON or SceneFile::Write turn
+//them into files. Uses its own random generator so a seed gives the same scene on every platform.
+class SceneGenerator
+{
+public:
+	static ReadSphere* Generate(const GeneratorSettings& generator);
+	//Parses spec then generates, null with a message if the spec isn't valid
+	static ReadSphere* Generate(const char* spec);
+	static void PrintUsage();
+};
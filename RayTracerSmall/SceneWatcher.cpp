@@ -0,0 +1,105 @@
+#include "SceneWatcher.h"
+#include <iostream>
+#include <thread>
+#include <chrono>
+#ifdef _WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#else
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+SceneWatcher::SceneWatcher()
+{
+
+}
+
+SceneWatcher::~SceneWatcher()
+{
+#ifndef _WIN32
+	if (m_fd >= 0)
+		close(m_fd);
+#endif
+}
+
+bool SceneWatcher::Open(const char* path)
+{
+	std::string fullPath = path;
+	size_t slash = fullPath.find_last_of("/\\");
+	m_directory = slash == std::string::npos ? "." : fullPath.substr(0, slash);
+	m_name = slash == std::string::npos ? fullPath : fullPath.substr(slash + 1);
+#ifdef _WIN32
+	m_modified = GetModified();
+	return m_modified != 0;
+#else
+	m_fd = inotify_init1(IN_CLOEXEC);
+	if (m_fd < 0)
+		return false;
+	return inotify_add_watch(m_fd, m_directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) >= 0;
+#endif
+}
+
+#ifdef _WIN32
+long long SceneWatcher::GetModified()
+{
+	struct _stat64 info;
+	std::string path = m_directory + "\\" + m_name;
+	if (_stat64(path.c_str(), &info) != 0)
+		return 0;
+	return (long long)info.st_mtime;
+}
+
+bool SceneWatcher::WaitForChange()
+{
+	while (true)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(250));
+		long long modified = GetModified();
+		if (modified != 0 && modified != m_modified)
+		{
+			m_modified = modified;
+			std::this_thread::sleep_for(std::chrono::milliseconds(SCENE_WATCH_SETTLE_MS));
+			return true;
+		}
+	}
+}
+#else
+bool SceneWatcher::ReadEvents()
+{
+	//room for plenty of events with their names
+	alignas(inotify_event) char events[16 * 1024];
+	ssize_t length = read(m_fd, events, sizeof(events));
+	if (length <= 0)
+		return false;
+
+	bool changed = false;
+	for (char* next = events; next < events + length; )
+	{
+		const inotify_event* event = (const inotify_event*)next;
+		if (event->len > 0 && m_name == event->name)
+			changed = true;
+		next += sizeof(inotify_event) + event->len;
+	}
+	return changed;
+}
+
+bool SceneWatcher::WaitForChange()
+{
+	if (m_fd < 0)
+		return false;
+	pollfd watch = { m_fd, POLLIN, 0 };
+	while (true)
+	{
+		if (poll(&watch, 1, -1) < 0)
+			return false;
+		if (!ReadEvents())
+			continue;
+		//editors often save in several steps, so wait until the directory goes quiet
+		while (poll(&watch, 1, SCENE_WATCH_SETTLE_MS) > 0)
+			ReadEvents();
+		return true;
+	}
+}
+#endif
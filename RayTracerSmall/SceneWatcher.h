@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+
+//Time allowed for an editor to finish saving before the scene is reloaded
+#define SCENE_WATCH_SETTLE_MS 100
+
+//Notices when a scene file is edited. Watches the file's directory rather than the file, so editors that
+//save by writing a new file and renaming it over the old one are seen too.
+class SceneWatcher
+{
+public:
+	SceneWatcher();
+	~SceneWatcher();
+
+	bool Open(const char* path);
+	//Blocks until the file has been written or replaced and the writes have settled, false if watching failed
+	bool WaitForChange();
+
+private:
+	std::string m_directory;
+	std::string m_name;
+#ifdef _WIN32
+	//no inotify, so the modification time is polled
+	long long m_modified = 0;
+	long long GetModified();
+#else
+	int m_fd = -1;
+	//reads whatever events are waiting, true if any were for the scene file
+	bool ReadEvents();
+#endif
+};
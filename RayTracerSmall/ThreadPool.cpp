@@ -64,12 +64,14 @@ ThreadPool::~ThreadPool()
 void ThreadPool::Enqueue(std::function<void()> task)
 {
 #ifdef _WIN32
-    //Add the task passed through onto the queue and add onto the task count
+    //Add the task passed through onto the queue and add onto the task count, tasks can be queued from workers too
+    std::lock_guard<std::mutex> guard(waitMutex);
     tasks.push(task);
     tasksRemaining++;
 #else
     if (LINUX_POOLING)
     {
+        std::lock_guard<std::mutex> guard(waitMutex);
         tasks.push(task);
         tasksRemaining++;
     }
@@ -84,14 +86,15 @@ void ThreadPool::Enqueue(std::function<void()> task)
 void ThreadPool::WaitUntilCompleted()
 {
 #ifdef _WIN32
-    //A condition variable is created which will lock the main thread until condition is met
+    //A condition variable is created which will lock the main thread until condition is met, the check means
+    //tasks that finish before the wait starts aren't missed
     std::unique_lock<std::mutex> lock(*mainMutex);
-    cv.wait(lock);
+    cv.wait(lock, [this]() { return tasksRemaining == 0; });
 #else
     if (LINUX_POOLING)
     {
         std::unique_lock<std::mutex> lock(*mainMutex);
-        cv.wait(lock);
+        cv.wait(lock, [this]() { return tasksRemaining == 0; });
     }
     else
     {
@@ -102,6 +105,62 @@ void ThreadPool::WaitUntilCompleted()
 #endif // _WIN32
 }
 
+//Shared between the caller of ParallelFor and the helper tasks, which may only start after the caller returns
+struct ParallelForJob
+{
+    int count;
+    std::function<void(int)> body;
+    std::atomic<int> next{ 0 };
+    std::atomic<int> done{ 0 };
+    std::mutex doneMutex;
+    std::condition_variable doneCV;
+};
+
+void ThreadPool::ParallelFor(int count, std::function<void(int)> body)
+{
+    std::shared_ptr<ParallelForJob> job = std::make_shared<ParallelForJob>();
+    job->count = count;
+    job->body = body;
+
+    //Each worker claims the next index until none are left
+    auto work = [job]()
+    {
+        int i;
+        while ((i = job->next++) < job->count)
+        {
+            job->body(i);
+            if (++job->done == job->count)
+            {
+                std::lock_guard<std::mutex> guard(job->doneMutex);
+                job->doneCV.notify_all();
+            }
+        }
+    };
+
+#ifdef _WIN32
+    bool pooling = true;
+#else
+    //Forked tasks couldn't hand their results back, so without pooling the caller does all the work
+    bool pooling = LINUX_POOLING;
+#endif // _WIN32
+    if (pooling)
+    {
+        int helpers = count - 1 < threadCount ? count - 1 : threadCount;
+        for (int i = 0; i < helpers; i++)
+        {
+            Enqueue([this, work]()
+                {
+                    ReleaseLock();
+                    work();
+                });
+        }
+    }
+
+    work();
+    std::unique_lock<std::mutex> lock(job->doneMutex);
+    job->doneCV.wait(lock, [job]() { return job->done == job->count; });
+}
+
 void ThreadPool::Lock()
 {
     std::unique_lock<std::mutex> localLock(waitMutex);
@@ -144,6 +203,8 @@ void* ThreadPool::ThreadFunc()
                 task();
                 if (--tasksRemaining == 0) //Count down after each task is completed
                 {
+                    //Taking the main mutex means the main thread is either waiting already or hasn't checked yet
+                    { std::lock_guard<std::mutex> guard(*mainMutex); }
                     cv.notify_one(); //Unblock the main thread when all tasks are done
                 }
                 //ReleaseLock();
@@ -6,6 +6,8 @@
 #include <queue>
 #include <mutex>
 #include <iostream>
+#include <atomic>
+#include <memory>
 #include "Global.h"
 #ifdef _WIN32
 #include <thread>
@@ -35,6 +37,10 @@ public:
 
 	void WaitUntilCompleted();
 
+	// Runs body(0) to body(count - 1) across the pool with the calling thread joining in, and returns once
+	// every index is done. Call it from outside the pool or from a task that has already called ReleaseLock.
+	void ParallelFor(int count, std::function<void(int)> body);
+
 	void* ThreadFunc();
 
 private:
@@ -46,7 +52,7 @@ private:
 	void MakeForks(std::function<void()> task);
 #endif // _WIN32
 	queue<std::function<void()>> tasks;
-	int tasksRemaining = 0;
+	std::atomic<int> tasksRemaining{ 0 };
 	int threadCount;
 
 	std::mutex(waitMutex);
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <ostream>
+
 #if defined __linux__ || defined __APPLE__
 #include <math.h>
 // "Compiled for Linux
@@ -0,0 +1,115 @@
+#include "VideoPipe.h"
+#include <sstream>
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#else
+#include <csignal>
+#include <cerrno>
+#include <spawn.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/wait.h>
+extern char** environ;
+#endif
+
+VideoPipe::VideoPipe(FrameWriter* writer) : OrderedFrameSink(writer)
+{
+
+}
+
+VideoPipe::~VideoPipe()
+{
+	Close();
+}
+
+bool VideoPipe::Open(unsigned width, unsigned height, const char* outputPath)
+{
+	//raw rgb24 frames come in on stdin, the rest matches the old post-render ffmpeg command
+	std::string size = std::to_string(width) + "x" + std::to_string(height);
+	std::string framerate = std::to_string(VIDEO_FRAMERATE);
+	m_failed = false;
+#ifdef _WIN32
+	std::stringstream command;
+	command << "ffmpeg -loglevel error -f rawvideo -pix_fmt rgb24 -s " << size << " -framerate " << framerate
+		<< " -i - -vcodec mpeg4 " << outputPath << " -y";
+	m_pipe = popen(command.str().c_str(), "wb");
+	if (m_pipe == nullptr)
+		return false;
+#else
+	//spawned directly rather than through a shell, so a missing ffmpeg fails here instead of on the first write
+	const char* argv[] = { "ffmpeg", "-loglevel", "error", "-f", "rawvideo", "-pix_fmt", "rgb24", "-s", size.c_str(),
+		"-framerate", framerate.c_str(), "-i", "-", "-vcodec", "mpeg4", outputPath, "-y", nullptr };
+	int fds[2];
+	if (pipe(fds) != 0)
+		return false;
+	fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_adddup2(&actions, fds[0], STDIN_FILENO);
+	posix_spawn_file_actions_addclose(&actions, fds[0]);
+	int result = posix_spawnp(&m_ffmpeg, "ffmpeg", &actions, nullptr, (char* const*)argv, environ);
+	posix_spawn_file_actions_destroy(&actions);
+	close(fds[0]);
+	if (result != 0)
+	{
+		close(fds[1]);
+		m_ffmpeg = -1;
+		return false;
+	}
+	m_pipe = fdopen(fds[1], "w");
+#endif
+	//unbuffered, so every byte is written inside WriteFrameData and nothing is left for Close to flush
+	setvbuf(m_pipe, nullptr, _IONBF, 0);
+
+	StartSequencer();
+	return true;
+}
+
+void VideoPipe::Close()
+{
+	if (m_pipe == nullptr)
+		return;
+	StopSequencer();
+
+	//closing the pipe ends ffmpeg's input, then wait for it to finish encoding
+#ifdef _WIN32
+	pclose(m_pipe);
+#else
+	fclose(m_pipe);
+	int status;
+	while (waitpid(m_ffmpeg, &status, 0) < 0 && errno == EINTR)
+		;
+	m_ffmpeg = -1;
+#endif
+	m_pipe = nullptr;
+}
+
+void VideoPipe::WriteFrameData(int frameIndex, FrameBuffer* buffer)
+{
+	if (m_failed)
+		return;
+#ifndef _WIN32
+	//if ffmpeg has gone, the write fails with EPIPE instead of SIGPIPE killing the process. SIGPIPE from a write
+	//goes to the writing thread, so blocking it here and taking any that arrived leaves every other thread alone.
+	sigset_t pipeSignal, oldMask;
+	sigemptyset(&pipeSignal);
+	sigaddset(&pipeSignal, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &pipeSignal, &oldMask);
+#endif
+	m_failed = fwrite(buffer->data, 1, buffer->length, m_pipe) != buffer->length;
+#ifndef _WIN32
+	timespec noWait = { 0, 0 };
+	while (sigtimedwait(&pipeSignal, nullptr, &noWait) > 0)
+		;
+	pthread_sigmask(SIG_SETMASK, &oldMask, nullptr);
+#endif
+	if (m_failed)
+	{
+		std::stringstream outputMsg;
+		outputMsg << "VideoPipe: ffmpeg stopped accepting frames at frame " << frameIndex << ", the rest are dropped" << std::endl;
+		std::cout << outputMsg.str();
+	}
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "OrderedFrameSink.h"
+#include <cstdio>
+#include <string>
+#ifndef _WIN32
+#include <sys/types.h>
+#endif
+
+//Frames per second of the encoded video, matches the old ffmpeg command in main
+#define VIDEO_FRAMERATE 25
+
+//Streams raw RGB frames into a single ffmpeg process over a pipe, in frame order
+class VideoPipe : public OrderedFrameSink
+{
+public:
+	VideoPipe(FrameWriter* writer);
+	~VideoPipe();
+
+	//Returns false if ffmpeg isn't installed or couldn't be started
+	bool Open(unsigned width, unsigned height, const char* outputPath);
+	//Writes everything still buffered and waits for ffmpeg to finish
+	void Close();
+
+	bool IsOpen() { return m_pipe != nullptr; }
+
+protected:
+	void WriteFrameData(int frameIndex, FrameBuffer* buffer) override;
+
+private:
+	FILE* m_pipe = nullptr;
+	//set once a write fails, the rest of the frames are dropped rather than each reporting it again
+	bool m_failed = false;
+#ifndef _WIN32
+	pid_t m_ffmpeg = -1;
+#endif
+};
@@ -28,11 +28,11 @@
 #include <iostream>
 #include <cassert>
 #include <cctype>
+#include <cstring>
+#include <sstream>
 // Windows only
 #ifdef _WIN32
 #include <algorithm>
-#include <sstream>
-#include <string.h>
 #include <thread>
 #include <mutex>
 #endif
@@ -40,6 +40,7 @@
 #include "Global.h"
 #include "RayTracer.h"
 #include "ThreadPool.h"
+#include "JobList.h"
 
 //[comment]
 // In the main function, we will create the scene which is composed of 5 spheres
@@ -52,9 +53,80 @@ int main(int argc, char **argv)
 	srand(13);
 	HeapDirector::CreateDefaultHeap();
 
+	//any --name=value arguments override the default render settings
+	RenderSettings settings;
+	for (int i = 1; i < argc; i++)
+	{
+		if (!settings.ParseArg(argv[i]))
+		{
+			std::cout << "Unknown argument: " << argv[i] << std::endl;
+			RenderSettings::PrintUsage();
+			return 1;
+		}
+	}
+
+	//pulling frames back out of an archive doesn't need a render
+	if (settings.extractPath != nullptr)
+		return FrameArchiveReader::ExtractPPM(settings.extractPath, settings.outputDirectory, settings.extractFrame) ? 0 : 1;
+
+	if (settings.generateSpec != nullptr && strcmp(settings.generateSpec, "help") == 0)
+	{
+		SceneGenerator::PrintUsage();
+		return 0;
+	}
+
+	//a job list renders many scenes through one pool rather than paying for a process each
+	if (settings.jobsPath != nullptr)
+	{
+		JobList jobs;
+		if (!jobs.Load(settings.jobsPath, settings))
+			return 1;
+		std::mutex* mainMutex = new std::mutex();
+		ThreadPool* threadPool = new ThreadPool(20, mainMutex);
+		int failed = jobs.Run(threadPool);
+		delete(threadPool);
+		delete(mainMutex);
+
+		auto stop = std::chrono::high_resolution_clock::now();
+		auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start);
+		std::cout << "\n" << jobs.GetCount() - failed << " of " << jobs.GetCount() << " jobs rendered, time taken: " << duration.count() << "ms" << std::endl;
+		return failed == 0 ? 0 : 1;
+	}
+
+	//the scene is generated or loaded before anything else, so its load time is part of the total
+	ReadSphere* scene;
+	const char* sceneName = settings.generateSpec != nullptr ? "generated scene" : settings.scenePath;
+	if (settings.generateSpec != nullptr)
+		scene = SceneGenerator::Generate(settings.generateSpec);
+	else
+		scene = SceneFile::LoadScene(settings.scenePath);
+
+	if (scene == nullptr)
+		return 1;
+
+	//compiling or exporting a scene just converts it, nothing is rendered
+	if (settings.compilePath != nullptr || settings.exportPath != nullptr)
+	{
+		bool converted = true;
+		if (settings.compilePath != nullptr && (converted = SceneFile::Write(scene, settings.compilePath)))
+			std::cout << "Compiled " << sceneName << " to " << settings.compilePath << std::endl;
+		if (converted && settings.exportPath != nullptr && (converted = JSONReader::SaveJSON(scene, settings.exportPath)))
+			std::cout << "Exported " << sceneName << " to " << settings.exportPath << std::endl;
+		delete(scene);
+		return converted ? 0 : 1;
+	}
+
 	std::mutex* mainMutex = new std::mutex();
 	ThreadPool* threadPool = new ThreadPool(20, mainMutex);
-	Raytracer* r = new Raytracer("SphereJSON.json", threadPool);
+	Raytracer* r = new Raytracer(scene, threadPool, settings);
+	if (settings.watch && settings.generateSpec == nullptr)
+		r->Watch();
+	else if (settings.watch)
+		std::cout << "A generated scene has no file to watch" << std::endl;
+
+	//ffmpeg only has something to do afterwards when the frames were written as PPM files
+	OutputFormat outputFormat = r->GetSettings().outputFormat;
+	bool ppmWritten = outputFormat == OUTPUT_PPM || outputFormat == OUTPUT_PPM_MAPPED;
 
 	auto stop = std::chrono::high_resolution_clock::now();
 	auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(stop - start);
@@ -64,12 +136,23 @@ int main(int argc, char **argv)
 	delete(threadPool);
 	delete(mainMutex);
 
+#if MEMORY_DEBUG
+	//anything still live at this point has outlived the render
+	HeapDirector::DumpHeaps();
+#endif
+
+	if (!ppmWritten)
+		return 0;
+
 	string userInput = "";
 	std::cout << "\nCreate video using the ffmpeg? Y/N: ";
 	std::cin >> userInput;
 	if (userInput == "Y" || userInput == "y")
 	{
-		system("ffmpeg -framerate 25 -i output/spheres%d.ppm -vcodec mpeg4 output.mp4 -y");
+		std::stringstream command;
+		command << "ffmpeg -framerate 25 -start_number " << settings.firstFrame << " -i " << settings.outputDirectory << "/spheres%d.ppm -vcodec mpeg4 "
+			<< settings.outputDirectory << ".mp4 -y";
+		system(command.str().c_str());
 	}
 
 	return 0;